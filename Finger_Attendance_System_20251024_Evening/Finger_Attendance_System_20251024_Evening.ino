@@ -2,12 +2,19 @@
 #include "globals.h"
 #include "sd_functions.h"
 #include "wifi_functions.h"
+#include "display_task.h"
 #include "display_functions.h"
 #include "fingerprint_functions.h"
 #include "server_communication.h"
 #include "menu_system.h"
 #include "rtc_functions.h"
 #include "interrupts.h"
+#include "scheduler.h"
+#include "boot_timeline.h"
+#include "employee_groups.h"
+#include "punch_metrics.h"
+#include "punch_pipeline.h"
+#include "template_export.h"
 
 // Global object definitions
 Adafruit_SH1106G display(128, 64, &Wire, -1);
@@ -15,6 +22,12 @@ RTC_DS3231 rtc;
 HardwareSerial mySerial(2);
 Adafruit_Fingerprint finger(&mySerial);
 
+// Display task
+QueueHandle_t displayQueue = nullptr;
+QueueHandle_t toastQueue = nullptr;
+TaskHandle_t displayTaskHandle = nullptr;
+TaskHandle_t punchWriterHandle = nullptr;
+
 // Global variable definitions
 String auth_token = "";
 bool menuMode = false;
@@ -22,6 +35,8 @@ int currentMenu = 0;
 unsigned long menuStartTime = 0;
 unsigned long lastMenuInteraction = 0;
 volatile bool fingerTouched = false;
+volatile int64_t fingerTouchUs = 0;
+TaskHandle_t inputTaskHandle = nullptr;  // Loop task; woken by touch/button ISRs
 volatile bool buttonPressedFlag = false;
 bool buttonBeingHandled = false;
 unsigned long pressStartTime = 0;
@@ -31,6 +46,10 @@ const char *websiteText = "www.eonsystem.com";
 const int scrollDelay = 150;
 bool wifiConnected = false;
 
+// Boot
+volatile bool bootStorageOk = false;
+WiFiConfig bootWiFiConfig;
+
 // Menu items
 const char *menuItems[] = {
   "1. Register Finger",
@@ -40,7 +59,9 @@ const char *menuItems[] = {
   "5. List Fingerprints",
   "6. Show Logs",
   "7. Set WiFi",
-  "8. String device_idExit"
+  "8. Add Finger",
+  "9. Find Duplicates",
+  "10. Exit"
 };
 const int menuCount = sizeof(menuItems) / sizeof(menuItems[0]);
 
@@ -59,93 +80,129 @@ const uint8_t wifi_connected_icon[] PROGMEM = {
   0x01, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
 };
 
+// SD mount and the SD-backed loads run here while setup() brings up the
+// RTC and the fingerprint sensor on their own buses
+void bootStorageTask(void *param) {
+  TaskHandle_t setupTask = (TaskHandle_t)param;
+
+  SPI.begin(SD_SCK, SD_MISO, SD_MOSI, SD_CS);
+  bootStorageOk = SD.begin(SD_CS);
+  if (bootStorageOk) {
+    loadFingerprintDB();
+    loadEmployeeGroups();
+    bootWiFiConfig = loadWiFiConfig();
+    auth_token = loadAuthToken();
+  }
+
+  xTaskNotifyGive(setupTask);
+  vTaskDelete(nullptr);
+}
+
 void setup() {
   Serial.begin(115200);
+  bootMark("serial");
 
   // Initialize hardware
   Wire.begin(I2C_SDA, I2C_SCL);
   display.begin(0x3C, true);
+  startDisplayTask();
+  showStatusScreen("Starting");
+  bootMark("display");
 
-  display.clearDisplay();
-  display.setTextSize(2);
-  display.setTextColor(SH110X_WHITE);
-  display.setCursor((128 - 5 * 18) / 2, 20);
-  display.print("Starting");
-  display.display();
-
-  mySerial.begin(57600, SERIAL_8N1, FINGERPRINT_RX, FINGERPRINT_TX);
-  SPI.begin(SD_SCK, SD_MISO, SD_MOSI, SD_CS);
-
-  if (!SD.begin(SD_CS)) {
-    Serial.println("SD Card initialization failed!");
-    display.clearDisplay();
-    display.println("Storage!");
-    display.display();
-  }
-
-  // Load fingerprint database
-  loadFingerprintDB();
-
-  // Initialize WiFi from SD card
-  WiFiConfig config = loadWiFiConfig();
-  if (config.ssid.length() > 0) {
-    initWiFi(config);
-  } else {
-    enterConfigMode();
-  }
+  xTaskCreatePinnedToCore(bootStorageTask, "bootStorage", BOOT_STORAGE_TASK_STACK,
+                          xTaskGetCurrentTaskHandle(), 1, nullptr, 0);
 
   // Initialize GPIOs
   pinMode(TOUCH_PIN, INPUT_PULLUP);
   pinMode(BUTTON_PIN, INPUT_PULLUP);
   pinMode(BUZZER_PIN, OUTPUT);
   digitalWrite(BUZZER_PIN, LOW);
-  attachInterrupt(digitalPinToInterrupt(TOUCH_PIN), onFingerTouch, FALLING);
-  attachInterrupt(digitalPinToInterrupt(BUTTON_PIN), onButtonPress, FALLING);
+  initBuzzer();
+  bootMark("gpio");
 
-  // Initialize RTC
-  if (!rtc.begin()) {
-    display.clearDisplay();
-    display.println("Time Error!");
-    display.display();
+  // Initialize RTC and the software clock
+  if (!timeBegin()) {
+    showBootError("Time Error!");
   }
-  if (rtc.lostPower()) rtc.adjust(DateTime(F(__DATE__), F(__TIME__)));
+  bootMark("rtc");
 
   // Initialize Fingerprint
+  mySerial.begin(57600, SERIAL_8N1, FINGERPRINT_RX, FINGERPRINT_TX);
   if (!finger.verifyPassword()) {
-    display.clearDisplay();
-    display.println("Sensor error!");
-    display.display();
+    showBootError("Sensor error!");
   }
-  
-  loadAndValidateToken();
-  display.clearDisplay();
-  showCountdown();
+  bootMark("sensor");
+
+  // Join the storage task. A slow card is waited out rather than left
+  // behind: the task still writes the boot globals, and the punch writer
+  // mustn't touch SD before SD.begin() has returned.
+  if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(BOOT_STORAGE_TIMEOUT_MS)) == 0) {
+    Serial.println("SD card slow to respond; still waiting");
+    showStatusScreen("Waiting for SD");
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+  if (!bootStorageOk) {
+    Serial.println("SD Card initialization failed!");
+    showBootError("Storage!");
+  }
+  startPunchWriter();
+  bootMark("storage");
+
+  // Initialize WiFi from SD card; connects in the background and SNTP
+  // reports each sync to syncRTCTime()
+  timeSyncBegin();
+  if (bootWiFiConfig.ssid.length() > 0) {
+    initWiFi(bootWiFiConfig);
+  } else {
+    enterConfigMode();
+  }
+  metricsBegin();
+  bootMark("wifi");
+
+  inputTaskHandle = xTaskGetCurrentTaskHandle();
+  attachInterrupt(digitalPinToInterrupt(TOUCH_PIN), onFingerTouch, FALLING);
+  attachInterrupt(digitalPinToInterrupt(BUTTON_PIN), onButtonPress, FALLING);
+  updateDisplay();
+  bootMark("ready");
+
+  // Background jobs
+  schedulerAddPeriodic("wifi", maintainWiFi, WIFI_CHECK_INTERVAL, WIFI_POLL_INTERVAL,
+                       0, WIFI_POLL_INTERVAL);
+  schedulerAddOnce("token", validateTokenJob, WIFI_POLL_INTERVAL, 0, tokenBackoff);
+  schedulerAddPeriodic("attendance_sync", processPendingAttendances, SYNC_INTERVAL,
+                       SYNC_INTERVAL, SYNC_JITTER_MS, SYNC_RETRY_DELAY);
+  schedulerAddPeriodic("fingerprint_sync", sendNewFingerprintsToServer, FINGERPRINT_SYNC_INTERVAL,
+                       FINGERPRINT_SYNC_INTERVAL, SYNC_JITTER_MS);
+  schedulerAddPeriodic("time_resync", timeResyncJob, TIME_RESYNC_INTERVAL, TIME_RESYNC_INTERVAL);
+  schedulerAddPeriodic("health", sampleHealth, HEALTH_SAMPLE_INTERVAL);
+  schedulerAddPeriodic("template_keys", fetchTemplateKeysJob, TEMPLATE_KEY_CHECK_INTERVAL,
+                       WIFI_POLL_INTERVAL, 0, SYNC_RETRY_DELAY);
+  if (bootStorageOk) bulkExportResume();
+
+  printBootTimeline();
 }
 
 void loop() {
-  maintainWiFi();
-  processPendingAttendances();
-  sendNewFingerprintsToServer();
+  schedulerRun();
   
   if (menuMode) {
     handleMenuNavigation();
     return;
   }
 
-  // Normal operation
-  updateDisplay();
-
+  // Normal operation: the display task keeps the home screen and result
+  // toasts up to date, so the next touch is picked up immediately
   if (fingerTouched) {
     fingerTouched = false;
-    delay(200);
+    metricsRecordSince(STAGE_TOUCH_PICKUP, fingerTouchUs);
     checkAttendance();
-    delay(1000);
   }
   
   if (buttonPressedFlag && !menuMode) {
     enterMenuMode();
     return;
   }
-  
-  syncRTCTime();
+
+  // Sleep until a touch or button interrupt, or the next job is due
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(schedulerMsUntilDue()));
 }
\ No newline at end of file
@@ -0,0 +1,38 @@
+#ifndef BOOT_TIMELINE_H
+#define BOOT_TIMELINE_H
+
+#include "config.h"
+#include "globals.h"
+
+// Per-phase boot timing. setup() calls bootMark() as each phase finishes;
+// printBootTimeline() reports how long each phase took and when the
+// terminal became ready for punches.
+
+struct BootPhase {
+  const char *name;
+  uint32_t endUs;
+};
+
+static BootPhase bootPhases[BOOT_MAX_PHASES];
+static uint8_t bootPhaseCount = 0;
+
+void bootMark(const char *name) {
+  if (bootPhaseCount >= BOOT_MAX_PHASES) return;
+  bootPhases[bootPhaseCount].name = name;
+  bootPhases[bootPhaseCount].endUs = micros();
+  bootPhaseCount++;
+}
+
+void printBootTimeline() {
+  Serial.println("\n=== Boot Timeline ===");
+  uint32_t prevUs = 0;
+  for (uint8_t i = 0; i < bootPhaseCount; i++) {
+    const BootPhase &phase = bootPhases[i];
+    Serial.printf("%-16s +%6lu us  (at %7lu us)\n", phase.name,
+                  (unsigned long)(phase.endUs - prevUs), (unsigned long)phase.endUs);
+    prevUs = phase.endUs;
+  }
+  Serial.println("=====================\n");
+}
+
+#endif
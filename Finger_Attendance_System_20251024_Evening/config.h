@@ -9,15 +9,31 @@ const String cid = "TFL";
 // Server Configuration
 // const String base_url = "http://34.142.226.62:9001";
 const String base_url = "http://161.248.247.217:9001";
+// Template keys are only ever fetched over TLS, from this URL with this
+// CA (PEM); leave either empty and templates stay plain
+const String TEMPLATE_KEY_URL = "";
+const char *const TEMPLATE_KEY_CA_CERT = "";
+const unsigned long TEMPLATE_KEY_CHECK_INTERVAL = 3600000;
 
 // File Paths
 const String TOKEN_FILE = "/auth_token.txt";
 const String PENDING_ATTENDANCE_FILE = "/pending_attendance.csv";
+const String PENDING_ATTENDANCE_INFLIGHT_FILE = "/pending_attendance.inflight";
+const String PENDING_ATTENDANCE_BAD_FILE = "/pending_attendance.bad";
 const String PENDING_FINGERPRINTS_FILE = "/pending_fingerprints.csv";
 
 // Timing Constants
 const unsigned long SYNC_INTERVAL = 5 * 60 * 1000;
 const unsigned long SYNC_RETRY_DELAY = 1 * 60 * 1000;
+const unsigned long SYNC_JITTER_MS = 5000;
+const unsigned long MIN_SERVER_SYNC_INTERVAL_S = 30;
+const unsigned long MAX_SERVER_SYNC_INTERVAL_S = 24UL * 3600;
+const unsigned long FINGERPRINT_SYNC_INTERVAL = 2 * 60 * 1000;
+const unsigned long WIFI_CHECK_INTERVAL = 30000;
+const unsigned long WIFI_CONNECT_TIMEOUT = 15000;
+const unsigned long WIFI_POLL_INTERVAL = 1000;
+const unsigned long RTC_SYNC_INTERVAL = 3600000;
+const unsigned long TIME_RESYNC_INTERVAL = 3600000;
 const int MAX_RETRIES = 3;
 const int MAX_FINGERPRINT_RECORDS = 50;
 
@@ -33,11 +49,112 @@ const int MAX_FINGERPRINT_RECORDS = 50;
 #define TOUCH_PIN 25
 #define BUTTON_PIN 21
 #define BUZZER_PIN 32
+#define RTC_SQW_PIN 33  // DS3231 SQW (open drain); -1 if not wired
+
+// Touch
+#define FINGER_TOUCH_DEBOUNCE_US 500000
+#define FINGER_SETTLE_TIMEOUT_MS 300  // Keep polling getImage this long after a touch
 
 // Other Constants
 #define LONG_PRESS_THRESHOLD 1000
+#define MENU_VISIBLE_ROWS 5
 const unsigned long menuTimeout = 10000;
 
+// Boot
+#define BOOT_MAX_PHASES 12
+#define BOOT_STORAGE_TIMEOUT_MS 3000
+#define BOOT_STORAGE_TASK_STACK 6144
+
+// Scheduler
+#define SCHEDULER_MAX_JOBS 10
+#define SCHEDULER_IDLE_CHECK_MS 1000
+#define SCHEDULER_MAX_BACKOFF_MS (30UL * 60 * 1000)
+
+// Health Monitor
+#define HEALTH_SAMPLE_INTERVAL 60000
+#define HEALTH_HISTORY 60                 // One hour of samples
+#define HEALTH_HEAP_WARN_BYTES 32768
+#define HEALTH_HEAP_CRITICAL_BYTES 16384
+#define HEALTH_BLOCK_WARN_BYTES 16384     // Enough for a sync payload and TLS-free HTTP
+#define HEALTH_STACK_WARN_BYTES 512
+#define HEALTH_FORECAST_S (24UL * 3600)
+
+// Metrics
+#define METRICS_POLL_INTERVAL 50  // WebServer service period for /metrics
+#define METRICS_TASK_STACK 4096
+#define METRICS_TASK_PRIORITY 1
+#define METRICS_TASK_CORE 0
+
+// Logging
+#define LOG_LEVEL LOG_LEVEL_INFO  // Compile-time ceiling; see log.h
+#define LOG_RING_SIZE 2048
+#define LOG_LINE_LEN 160
+
+// Employee Groups
+#define FINGER_SLOT_COUNT 300
+const String EMPLOYEE_GROUPS_FILE = "/finger_groups.csv";
+#define RECOGNITION_RETRY_PCT 30       // Flag for re-enrolment above this retry rate
+#define RECOGNITION_MIN_CONFIDENCE 80  // ...or below this average match score
+
+// Template Pack
+const String TEMPLATE_PACK_FILE = "/templates/templates.pak";
+const String TEMPLATE_PACK_TMP_FILE = "/templates/templates.tmp";
+const String TEMPLATE_PACK_BAD_FILE = "/templates/templates.bad";
+const String TEMPLATE_PACK_OLD_FILE = "/templates/templates.v1";  // Held while rewriting
+#define TEMPLATE_KEY_NAMESPACE "tplkey"        // NVS namespace for template keys
+#define TEMPLATE_KEY_OLD_NAMESPACE "tplcrypt"  // Fleet-wide keys, erased on boot
+#define TEMPLATE_MAX_BYTES 2048
+#define PACK_COMPACT_MIN_BYTES 16384  // Dead space worth a rewrite
+const String EXPORT_JOURNAL_FILE = "/templates/export.jnl";
+const String EXPORT_FAILED_FILE = "/templates/export_failed.txt";  // Slots the last export missed
+#define BULK_EXPORT_STEP_MS 20  // Gap between templates, for punches to get a turn
+
+// Duplicate Punches
+#define DUPLICATE_CACHE_SIZE 64
+#define DUPLICATE_WINDOW_S 60
+const unsigned long MAX_DUPLICATE_WINDOW_S = 3600;
+
+// Punch Writer
+#define PUNCH_QUEUE_LEN 32
+#define PUNCH_WRITER_STACK 4096
+#define PUNCH_WRITER_PRIORITY 1
+#define PUNCH_WRITER_CORE 0
+
+// Display Task
+#define DISPLAY_FRAME_MS 50
+#define DISPLAY_MAX_LINES 8
+#define DISPLAY_LINE_LEN 32
+#define DISPLAY_TASK_STACK 4096
+#define DISPLAY_TASK_PRIORITY 1
+#define DISPLAY_TASK_CORE 0
+
+// Feedback (toasts and buzzer)
+#define FEEDBACK_HOLD_MS 2000
+#define BUZZER_LEDC_CHANNEL 0
+#define BUZZER_LEDC_RES_BITS 10
+
+// Sensor Link
+#define SENSOR_RTT_SLOTS 16
+#define SENSOR_RTT_MIN_SAMPLES 4
+#define SENSOR_RTT_MAX_BACKOFF 4
+#define SENSOR_MIN_TIMEOUT_MS 100
+#define SENSOR_CMD_RETRIES 1
+#define TEMPLATE_VERIFY_DOWNLOAD true  // Read each DownChar back with UpChar
+#define SENSOR_DOWNCHAR_GAP_MS 50      // After each DownChar data packet; the R307 gap known to work
+#define SENSOR_DOWNCHAR_SETTLE_MS 300  // After the last packet when not reading back
+
+// Time Service
+#define RTC_SQW_MIN_PERIOD_US 900000
+#define RTC_SQW_STALE_US 2000000       // No edge for this long: SQW is not ticking
+#define RTC_ROLLOVER_POLL_MS 2         // Resync reads the RTC this often...
+#define RTC_ROLLOVER_TIMEOUT_MS 1100   // ...until its seconds change, at most this long
+#define TIME_QUALITY_MAX_AGE_S (24UL * 3600)
+#define TIME_ADJUST_THRESHOLD_MS 250
+#define TIME_TARGET_ERROR_MS 500
+#define TIME_SYNC_MIN_INTERVAL (15UL * 60 * 1000)
+#define TIME_SYNC_MAX_INTERVAL (24UL * 3600 * 1000)
+#define TIME_SYNC_HISTORY 8
+
 // WiFi Configuration
 const long gmtOffset_sec = 6 * 3600;
 const int daylightOffset_sec = 0;
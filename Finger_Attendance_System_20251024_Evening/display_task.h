@@ -0,0 +1,172 @@
+#ifndef DISPLAY_TASK_H
+#define DISPLAY_TASK_H
+
+#include "config.h"
+#include "globals.h"
+#include "time_service.h"
+
+// The render task is the only code that touches the Adafruit_SH1106G.
+// Everything else builds a ScreenFrame and posts it; the newest frame wins
+// and is drawn at most once per DISPLAY_FRAME_MS, so sensor and network
+// paths never wait on I2C.
+//
+// Screens come in two layers. postScreen() replaces the base screen (home,
+// menu, prompts). postToast() overlays a result screen for holdMs and then
+// falls back to the base; a newer toast pre-empts the one being shown.
+
+enum ScreenKind : uint8_t {
+  SCREEN_HOME,  // Device ID, WiFi icon, clock and scrolling website
+  SCREEN_TEXT   // Static text lines
+};
+
+struct ScreenLine {
+  int16_t x;
+  int16_t y;
+  uint8_t size;
+  char text[DISPLAY_LINE_LEN];
+};
+
+struct ScreenFrame {
+  ScreenKind kind;
+  uint16_t holdMs;  // Toasts only
+  uint8_t lineCount;
+  ScreenLine lines[DISPLAY_MAX_LINES];
+};
+
+// ---------------- Frame Builders (any task) ----------------
+ScreenFrame textScreen() {
+  ScreenFrame frame;
+  frame.kind = SCREEN_TEXT;
+  frame.holdMs = 0;
+  frame.lineCount = 0;
+  return frame;
+}
+
+void addScreenLine(ScreenFrame &frame, int16_t x, int16_t y, uint8_t size, const char *fmt, ...) {
+  if (frame.lineCount >= DISPLAY_MAX_LINES) return;
+  ScreenLine &line = frame.lines[frame.lineCount++];
+  line.x = x;
+  line.y = y;
+  line.size = size;
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(line.text, sizeof(line.text), fmt, args);
+  va_end(args);
+}
+
+void postScreen(const ScreenFrame &frame) {
+  if (displayQueue) xQueueOverwrite(displayQueue, &frame);
+}
+
+void postToast(ScreenFrame frame, uint16_t holdMs) {
+  frame.holdMs = holdMs;
+  if (toastQueue) xQueueOverwrite(toastQueue, &frame);
+}
+
+void showHomeScreen() {
+  ScreenFrame frame = textScreen();
+  frame.kind = SCREEN_HOME;
+  postScreen(frame);
+}
+
+// ---------------- Render Task (owns the display) ----------------
+static uint8_t frontBuffer[128 * 64 / 8];
+
+static void composeHome() {
+  display.clearDisplay();
+
+  // Top Left: Device ID
+  display.setTextSize(1);
+  display.setCursor(0, 0);
+  display.print("FP2025070001");
+
+  // Top Right: WiFi Status
+  int wifiX = 128 - 16 - 2;
+  display.drawBitmap(wifiX, 0, wifi_connected_icon, 16, 16, SH110X_WHITE);
+  if (WiFi.status() != WL_CONNECTED) {
+    display.setTextSize(2);
+    int textWidth = 6 * 2;
+    display.setCursor(128 - textWidth - 10, 0);
+    display.print("!");
+  }
+
+  // Middle: "Ready" or connection status
+  display.setTextSize(2);
+  display.setCursor((128 - 5 * 24) / 2, 20);
+  display.print("ChekinPlus");
+
+  // Time display
+  TimeSnapshot now = timeSnapshot();
+  display.setCursor((128 - 6 * 8 * 2) / 2, 40);
+  display.print(now.clock);
+
+  // Scrolling website
+  display.setTextSize(1);
+  int textWidth = strlen(websiteText) * 6;
+  if (millis() - lastScrollTime > scrollDelay) {
+    scrollPosition--;
+    if (scrollPosition < -textWidth) scrollPosition = 128;
+    lastScrollTime = millis();
+  }
+  display.setCursor(scrollPosition, 56);
+  display.print(websiteText);
+}
+
+static void composeText(const ScreenFrame &frame) {
+  display.clearDisplay();
+  for (uint8_t i = 0; i < frame.lineCount; i++) {
+    const ScreenLine &line = frame.lines[i];
+    display.setTextSize(line.size);
+    display.setCursor(line.x, line.y);
+    display.print(line.text);
+  }
+}
+
+// Push the back buffer to the panel only when it differs from what is shown
+static void flipIfChanged() {
+  uint8_t *backBuffer = display.getBuffer();
+  if (memcmp(backBuffer, frontBuffer, sizeof(frontBuffer)) == 0) return;
+  display.display();
+  memcpy(frontBuffer, backBuffer, sizeof(frontBuffer));
+}
+
+void displayTask(void *param) {
+  ScreenFrame base = textScreen();
+  ScreenFrame toast = textScreen();
+  bool toastActive = false;
+  unsigned long toastStart = 0;
+  TickType_t lastWake = xTaskGetTickCount();
+
+  display.setTextColor(SH110X_WHITE);
+  memset(frontBuffer, 0xFF, sizeof(frontBuffer));  // Force the first flip
+
+  for (;;) {
+    xQueueReceive(displayQueue, &base, 0);
+    if (xQueueReceive(toastQueue, &toast, 0) == pdTRUE) {
+      toastActive = true;
+      toastStart = millis();
+    }
+    if (toastActive && millis() - toastStart >= toast.holdMs) {
+      toastActive = false;
+    }
+
+    const ScreenFrame &current = toastActive ? toast : base;
+    if (current.kind == SCREEN_HOME) {
+      composeHome();
+    } else {
+      composeText(current);
+    }
+    flipIfChanged();
+
+    vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(DISPLAY_FRAME_MS));
+  }
+}
+
+void startDisplayTask() {
+  displayQueue = xQueueCreate(1, sizeof(ScreenFrame));
+  toastQueue = xQueueCreate(1, sizeof(ScreenFrame));
+  xTaskCreatePinnedToCore(displayTask, "display", DISPLAY_TASK_STACK, nullptr,
+                          DISPLAY_TASK_PRIORITY, &displayTaskHandle, DISPLAY_TASK_CORE);
+}
+
+#endif
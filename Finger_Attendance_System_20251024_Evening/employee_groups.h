@@ -0,0 +1,99 @@
+#ifndef EMPLOYEE_GROUPS_H
+#define EMPLOYEE_GROUPS_H
+
+#include "config.h"
+#include "globals.h"
+#include "sd_functions.h"
+
+// Maps sensor template slots to employees so one person can have several
+// enrolled fingers. A slot with no entry belongs to the employee with the
+// same number, which keeps single-finger enrolments (and every record
+// logged before groups existed) meaning what they always did. The map is
+// stored on SD as "slot,emp_id" lines.
+//
+// Matches are also counted per employee: how many punches needed a
+// retry and how confident the sensor was, so people who are slow to
+// match can be found and re-enrolled.
+
+static uint16_t slotEmployee[FINGER_SLOT_COUNT + 1];  // 0 = same as slot
+
+struct RecognitionStats {
+  uint16_t punches;
+  uint16_t retried;        // Punches that needed more than one attempt
+  uint32_t confidenceSum;
+  uint16_t minConfidence;
+};
+
+static RecognitionStats recognitionStats[FINGER_SLOT_COUNT + 1];
+
+uint16_t employeeForSlot(uint16_t slot) {
+  if (slot == 0 || slot > FINGER_SLOT_COUNT) return slot;
+  return slotEmployee[slot] ? slotEmployee[slot] : slot;
+}
+
+bool saveEmployeeGroups() {
+  String data;
+  for (int slot = 1; slot <= FINGER_SLOT_COUNT; slot++) {
+    if (slotEmployee[slot]) data += String(slot) + "," + String(slotEmployee[slot]) + "\n";
+  }
+  return saveToSD(EMPLOYEE_GROUPS_FILE, data);
+}
+
+void loadEmployeeGroups() {
+  String content = readFromSD(EMPLOYEE_GROUPS_FILE);
+  int startPos = 0;
+  while (startPos < content.length()) {
+    int endPos = content.indexOf('\n', startPos);
+    if (endPos == -1) endPos = content.length();
+    String line = content.substring(startPos, endPos);
+    int commaPos = line.indexOf(',');
+    if (commaPos != -1) {
+      int slot = line.substring(0, commaPos).toInt();
+      int empId = line.substring(commaPos + 1).toInt();
+      if (slot >= 1 && slot <= FINGER_SLOT_COUNT && empId >= 1 && empId <= FINGER_SLOT_COUNT) {
+        slotEmployee[slot] = empId;
+      }
+    }
+    startPos = endPos + 1;
+  }
+}
+
+// Put a slot in an employee's group; the slot's own number when empId is 0
+void assignSlot(uint16_t slot, uint16_t empId) {
+  if (slot == 0 || slot > FINGER_SLOT_COUNT) return;
+  slotEmployee[slot] = (empId == slot) ? 0 : empId;
+  saveEmployeeGroups();
+}
+
+// A free slot can only start a new employee if no group still uses its number
+bool isEmployeeIdInUse(uint16_t empId) {
+  for (int slot = 1; slot <= FINGER_SLOT_COUNT; slot++) {
+    if (slotEmployee[slot] == empId) return true;
+  }
+  return false;
+}
+
+void recordRecognition(uint16_t empId, uint8_t attempts, uint16_t confidence) {
+  if (empId == 0 || empId > FINGER_SLOT_COUNT) return;
+  RecognitionStats &s = recognitionStats[empId];
+  if (s.punches == 0 || confidence < s.minConfidence) s.minConfidence = confidence;
+  if (s.punches < UINT16_MAX) s.punches++;
+  if (attempts > 1 && s.retried < UINT16_MAX) s.retried++;
+  s.confidenceSum += confidence;
+}
+
+void printRecognitionReport() {
+  Serial.println("\n=== Recognition Report (since boot) ===");
+  Serial.println("emp  name              punches  retried  avg-conf  min-conf");
+  for (int empId = 1; empId <= FINGER_SLOT_COUNT; empId++) {
+    const RecognitionStats &s = recognitionStats[empId];
+    if (s.punches == 0) continue;
+    uint16_t avg = s.confidenceSum / s.punches;
+    bool slow = s.retried * 100 >= s.punches * RECOGNITION_RETRY_PCT || avg < RECOGNITION_MIN_CONFIDENCE;
+    Serial.printf("%3d  %-16s %8u %8u %9u %9u%s\n", empId, getNameByID(empId),
+                  s.punches, s.retried, avg, s.minConfidence, slow ? "  <- re-enroll" : "");
+  }
+  Serial.println("=======================================\n");
+}
+
+#endif
\ No newline at end of file
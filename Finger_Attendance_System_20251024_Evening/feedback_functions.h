@@ -0,0 +1,119 @@
+#ifndef FEEDBACK_FUNCTIONS_H
+#define FEEDBACK_FUNCTIONS_H
+
+#include "config.h"
+#include "globals.h"
+#include "display_task.h"
+#include "esp_timer.h"
+
+// Result screens and buzzer patterns that run without blocking the caller.
+// Screens are shown as toasts by the display task. Buzzer patterns are
+// tone sequences generated by the LEDC peripheral and stepped by an
+// esp_timer, so no task sleeps while a pattern plays. A new pattern
+// pre-empts the one that is playing.
+
+enum BuzzerPattern : uint8_t {
+  BUZZ_SUCCESS,     // Punch accepted and sent on the next sync
+  BUZZ_FAIL,        // Not recognized / operation failed
+  BUZZ_DUPLICATE,   // Same employee punched again inside the window
+  BUZZ_QUEUED,      // Punch accepted while offline
+  BUZZ_SYNC_ERROR,  // Server rejected or failed a sync
+  BUZZ_PATTERN_COUNT
+};
+
+struct ToneStep {
+  uint16_t freqHz;      // 0 = silence
+  uint16_t durationMs;
+};
+
+struct TonePattern {
+  const ToneStep *steps;
+  uint8_t count;
+};
+
+static const ToneStep TONES_SUCCESS[] = { { 2700, 200 } };
+static const ToneStep TONES_FAIL[] = { { 2000, 100 }, { 0, 100 }, { 2000, 100 } };
+static const ToneStep TONES_DUPLICATE[] = { { 3200, 60 }, { 0, 60 }, { 3200, 60 } };
+static const ToneStep TONES_QUEUED[] = { { 2700, 150 }, { 0, 80 }, { 1800, 250 } };
+static const ToneStep TONES_SYNC_ERROR[] = { { 1200, 300 }, { 0, 100 }, { 900, 400 } };
+
+static const TonePattern tonePatterns[BUZZ_PATTERN_COUNT] = {
+  { TONES_SUCCESS, sizeof(TONES_SUCCESS) / sizeof(ToneStep) },
+  { TONES_FAIL, sizeof(TONES_FAIL) / sizeof(ToneStep) },
+  { TONES_DUPLICATE, sizeof(TONES_DUPLICATE) / sizeof(ToneStep) },
+  { TONES_QUEUED, sizeof(TONES_QUEUED) / sizeof(ToneStep) },
+  { TONES_SYNC_ERROR, sizeof(TONES_SYNC_ERROR) / sizeof(ToneStep) },
+};
+
+static esp_timer_handle_t buzzerTimer = nullptr;
+static portMUX_TYPE buzzerMux = portMUX_INITIALIZER_UNLOCKED;
+static const TonePattern *buzzerPattern = nullptr;
+static uint8_t buzzerStep = 0;
+
+static void buzzerTone(uint16_t freqHz) {
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+  ledcWriteTone(BUZZER_PIN, freqHz);
+#else
+  ledcWriteTone(BUZZER_LEDC_CHANNEL, freqHz);
+#endif
+}
+
+// Start the current step and arm the timer for its end; stops when done
+static void buzzerAdvance() {
+  uint16_t freqHz = 0;
+  uint16_t durationMs = 0;
+
+  portENTER_CRITICAL(&buzzerMux);
+  if (buzzerPattern && buzzerStep < buzzerPattern->count) {
+    freqHz = buzzerPattern->steps[buzzerStep].freqHz;
+    durationMs = buzzerPattern->steps[buzzerStep].durationMs;
+    buzzerStep++;
+  } else {
+    buzzerPattern = nullptr;
+  }
+  portEXIT_CRITICAL(&buzzerMux);
+
+  buzzerTone(freqHz);
+  if (durationMs > 0) {
+    esp_timer_start_once(buzzerTimer, (uint64_t)durationMs * 1000);
+  }
+}
+
+static void onBuzzerTimer(void *arg) {
+  buzzerAdvance();
+}
+
+void initBuzzer() {
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+  ledcAttach(BUZZER_PIN, 2000, BUZZER_LEDC_RES_BITS);
+#else
+  ledcSetup(BUZZER_LEDC_CHANNEL, 2000, BUZZER_LEDC_RES_BITS);
+  ledcAttachPin(BUZZER_PIN, BUZZER_LEDC_CHANNEL);
+#endif
+  buzzerTone(0);
+
+  esp_timer_create_args_t args = {};
+  args.callback = onBuzzerTimer;
+  args.dispatch_method = ESP_TIMER_TASK;
+  args.name = "buzzer";
+  esp_timer_create(&args, &buzzerTimer);
+}
+
+void playBuzzer(BuzzerPattern pattern) {
+  if (!buzzerTimer || pattern >= BUZZ_PATTERN_COUNT) return;
+
+  esp_timer_stop(buzzerTimer);
+  portENTER_CRITICAL(&buzzerMux);
+  buzzerPattern = &tonePatterns[pattern];
+  buzzerStep = 0;
+  portEXIT_CRITICAL(&buzzerMux);
+  buzzerAdvance();
+}
+
+// Show a result screen for `holdMs` and start its buzzer pattern; returns at once
+void showFeedback(const ScreenFrame &frame, BuzzerPattern pattern, uint16_t holdMs = FEEDBACK_HOLD_MS) {
+  postToast(frame, holdMs);
+  playBuzzer(pattern);
+}
+
+#endif
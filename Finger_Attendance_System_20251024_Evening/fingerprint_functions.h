@@ -5,9 +5,15 @@
 #include "globals.h"
 #include "utility_functions.h"
 #include "template_functions.h"  // ADD THIS'
+#include "punch_metrics.h"
+#include "punch_pipeline.h"
+#include "employee_groups.h"
 
-int findNextAvailableID() {
-  for (int id = 1; id <= 1000; id++) {
+// newEmployee: the slot number will become an emp_id, so skip numbers an
+// existing group still answers to
+int findNextAvailableID(bool newEmployee = true) {
+  for (int id = 1; id <= FINGER_SLOT_COUNT; id++) {
+    if (newEmployee && isEmployeeIdInUse(id)) continue;
     if (finger.loadModel(id) != FINGERPRINT_OK) {
       return id;
     }
@@ -15,10 +21,11 @@ int findNextAvailableID() {
   return -1;
 }
 bool captureFingerprint(int step, const char *prompt, const char *successMsg) {
-  display.clearDisplay();
-  display.printf("Step %d/2\n", step);
-  display.println(prompt);
-  display.display();
+  ScreenFrame frame = textScreen();
+  addScreenLine(frame, 0, 0, 1, "Step %d/2", step);
+  addScreenLine(frame, 0, 8, 1, "%s", prompt);
+  addScreenLine(frame, 120, 0, 1, "");
+  postScreen(frame);
 
   unsigned long start = millis();
   bool waiting = true;
@@ -34,10 +41,9 @@ bool captureFingerprint(int step, const char *prompt, const char *successMsg) {
     }
 
     static uint8_t dots = 0;
-    display.setCursor(120, 0);
-    display.print(".");
     dots = (dots + 1) % 4;
-    display.display();
+    snprintf(frame.lines[2].text, sizeof(frame.lines[2].text), "%s", dots ? "." : "");
+    postScreen(frame);
     delay(200);
   }
 
@@ -48,8 +54,8 @@ bool captureFingerprint(int step, const char *prompt, const char *successMsg) {
 
   Serial.println(successMsg);
   if (step == 1) {
-    display.println("Remove finger");
-    display.display();
+    addScreenLine(frame, 0, 16, 1, "Remove finger");
+    postScreen(frame);
     unsigned long removeStart = millis();
     while (finger.getImage() != FINGERPRINT_NOFINGER) {
       if (millis() - removeStart > 3000) {
@@ -61,16 +67,28 @@ bool captureFingerprint(int step, const char *prompt, const char *successMsg) {
   }
   return true;
 }
-void recordAttendance() {
-  String name = getNameByID(finger.fingerID);
-  DateTime now = rtc.now();
-  
-  char dateStr[11], timeStr[9];
-  sprintf(dateStr, "%02d/%02d/%04d", now.day(), now.month(), now.year());
-  sprintf(timeStr, "%02d:%02d:%02d", now.hour(), now.minute(), now.second());
+void recordAttendance(uint8_t attempts) {
+  int64_t displayStart = esp_timer_get_time();
+  uint16_t empId = employeeForSlot(finger.fingerID);
+  const char *name = getNameByID(empId);
+  recordRecognition(empId, attempts, finger.confidence);
+  TimeSnapshot now = timeSnapshot();
+  const char *dateStr = now.date;
+  const char *timeStr = now.clock;
+
+  // Repeat inside the window: acknowledge it, but log and sync nothing
+  if (isDuplicatePunch(empId)) {
+    Serial.printf("Duplicate punch - ID: %d suppressed\n", empId);
+    ScreenFrame frame = textScreen();
+    addScreenLine(frame, 0, 0, 2, "ID %d", empId);
+    addScreenLine(frame, 0, 16, 2, "%s", name);
+    addScreenLine(frame, 0, 40, 1, "Already recorded");
+    showFeedback(frame, BUZZ_DUPLICATE);
+    return;
+  }
 
   Serial.print("Success - ID: ");
-  Serial.print(finger.fingerID);
+  Serial.print(empId);
   Serial.print(" Name: ");
   Serial.print(name);
   Serial.print(" Time: ");
@@ -78,53 +96,61 @@ void recordAttendance() {
   Serial.print(" ");
   Serial.println(timeStr);
 
-  display.clearDisplay();
-  display.setTextSize(2);
-  display.setCursor(0, 0);
-  display.print("ID ");
-  display.print(finger.fingerID);
-  display.setCursor(0, 16);
-  display.print(name);
-  display.setCursor(0, 32);
-  display.print(dateStr);
-  display.print(timeStr);
-  display.setCursor(0, 24);
-  display.display();
-  buzzerSuccess();
-  digitalWrite(BUZZER_PIN, LOW);
-  delay(2000);
+  ScreenFrame frame = textScreen();
+  addScreenLine(frame, 0, 0, 2, "ID %d", empId);
+  addScreenLine(frame, 0, 16, 2, "%s", name);
+  addScreenLine(frame, 0, 32, 2, "%s%s", dateStr, timeStr);
+  showFeedback(frame, wifiConnected ? BUZZ_SUCCESS : BUZZ_QUEUED);
+  metricsRecordSince(STAGE_DISPLAY, displayStart);
 
-  logAttendance(finger.fingerID, name);
+  submitPunch(empId, name);
+  metricsRecordSince(STAGE_TOTAL, fingerTouchUs);
 }
 void checkAttendance() {
   const int maxRetries = 2;
   bool success = false;
   
-  display.fillRect(0, 32, 128, 32, SH110X_BLACK);
-  display.clearDisplay();
-  display.setTextSize(2);
-  display.setCursor((128 - 6 * 2 * 10) / 2, 20);
-  display.print("Scanning...");
-  display.display();
+  // Shown as a toast so it pre-empts the previous punch's result screen
+  ScreenFrame scanning = textScreen();
+  addScreenLine(scanning, (128 - 6 * 2 * 10) / 2, 20, 2, "Scanning...");
+  postToast(scanning, FEEDBACK_HOLD_MS);
 
   for (int attempt = 1; attempt <= maxRetries && !success; attempt++) {
     Serial.printf("Attempt %d/%d\n", attempt, maxRetries);
     
-    if (finger.getImage() != FINGERPRINT_OK) {
+    // Capture as soon as the sensor sees the finger; the touch pad can
+    // fire a little before the finger is flat on the glass
+    int64_t stageStart = esp_timer_get_time();
+    uint8_t result = finger.getImage();
+    while (result == FINGERPRINT_NOFINGER &&
+           esp_timer_get_time() - stageStart < FINGER_SETTLE_TIMEOUT_MS * 1000LL) {
+      result = finger.getImage();
+    }
+    metricsRecordSince(STAGE_GET_IMAGE, stageStart);
+    if (result == FINGERPRINT_OK && attempt == 1) {
+      metricsRecordSince(STAGE_TOUCH_TO_CAPTURE, fingerTouchUs);
+    }
+    if (result != FINGERPRINT_OK) {
       Serial.println("Finger not detected");
       delay(500);
       continue;
     }
 
-    if (finger.image2Tz() != FINGERPRINT_OK) {
+    stageStart = esp_timer_get_time();
+    result = finger.image2Tz();
+    metricsRecordSince(STAGE_IMAGE2TZ, stageStart);
+    if (result != FINGERPRINT_OK) {
       Serial.println("Image processing failed");
       delay(500);
       continue;
     }
 
-    if (finger.fingerSearch() == FINGERPRINT_OK) {
+    stageStart = esp_timer_get_time();
+    result = finger.fingerSearch();
+    metricsRecordSince(STAGE_SEARCH, stageStart);
+    if (result == FINGERPRINT_OK) {
       success = true;
-      recordAttendance();
+      recordAttendance(attempt);
     } else {
       Serial.println("Fingerprint not recognized");
       delay(500);
@@ -132,16 +158,10 @@ void checkAttendance() {
   }
 
   if (!success) {
-    display.clearDisplay();
-    display.setTextSize(2);
-    display.setCursor((128 - 6 * 2 * 10) / 2, 20);
-    display.print("Please Try");
-    display.setCursor((128 - 6 * 2 * 5) / 2, 40);
-    display.print("Again");
-    display.display();
-    buzzerFail();
-    digitalWrite(BUZZER_PIN, LOW);
-    delay(100);
+    ScreenFrame frame = textScreen();
+    addScreenLine(frame, (128 - 6 * 2 * 10) / 2, 20, 2, "Please Try");
+    addScreenLine(frame, (128 - 6 * 2 * 5) / 2, 40, 2, "Again");
+    showFeedback(frame, BUZZ_FAIL);
   }
 }
 bool saveFingerprintTemplate(int id, const String &name) {
@@ -153,13 +173,8 @@ bool saveFingerprintTemplate(int id, const String &name) {
     return false;
   }
 
-  DateTime now = rtc.now();
-  String timestamp = String(now.year()) + "-" + 
-                    (now.month() < 10 ? "0" : "") + String(now.month()) + "-" + 
-                    (now.day() < 10 ? "0" : "") + String(now.day()) + "T" + 
-                    (now.hour() < 10 ? "0" : "") + String(now.hour()) + ":" + 
-                    (now.minute() < 10 ? "0" : "") + String(now.minute()) + ":" + 
-                    (now.second() < 10 ? "0" : "") + String(now.second()) + "Z";
+  char timestamp[TS_ISO_LEN];
+  formatIsoTimestamp(timestamp, timeNowUnix());
 
   // Save to pending file: emp_id,timestamp,finger_id
   String record = String(id) + "," + timestamp + "," + templateData;
@@ -236,51 +251,53 @@ void enrollFingerprint(int id = -1) {
   }
 }*/
 
-void enrollFingerprint(int id = -1) {
+// empId: add the finger to that employee's group instead of creating one
+void enrollFingerprint(int id = -1, uint16_t empId = 0) {
   String name = "";
   
   if (id == -1) {
-    id = findNextAvailableID();
+    id = findNextAvailableID(empId == 0);
     if (id == -1) {
       failMessage("Database full!");
       return;
     }
-  } else if (id < 1 || id > 300) {
-    failMessage("Invalid ID (1-300)");
+  } else if (id < 1 || id > FINGER_SLOT_COUNT) {
+    failMessage("Invalid ID (1-" + String(FINGER_SLOT_COUNT) + ")");
     return;
   }
   
-  display.clearDisplay();
-  display.printf("Enrolling ID: %d", id);
-  display.setCursor(0, 16);
-  display.println("Enter name...");
-  display.display();
-  
-  // Prompt for name (you can enhance this with input method)
-  Serial.println("Enter employee name:");
-  unsigned long startTime = millis();
-  while (!Serial.available() && millis() - startTime < 10000) {
-    delay(100);
-  }
-  
-  if (Serial.available()) {
-    name = Serial.readStringUntil('\n');
-    name.trim();
-  }
-  
-  if (name.isEmpty()) {
-    name = "Employee_" + String(id);
+  ScreenFrame frame = textScreen();
+  if (empId) {
+    name = getNameByID(empId);
+  } else {
+    addScreenLine(frame, 0, 0, 1, "Enrolling ID: %d", id);
+    addScreenLine(frame, 0, 16, 1, "Enter name...");
+    postScreen(frame);
+    
+    // Prompt for name (you can enhance this with input method)
+    Serial.println("Enter employee name:");
+    unsigned long startTime = millis();
+    while (!Serial.available() && millis() - startTime < 10000) {
+      delay(100);
+    }
+    
+    if (Serial.available()) {
+      name = Serial.readStringUntil('\n');
+      name.trim();
+    }
+    
+    if (name.isEmpty()) {
+      name = "Employee_" + String(id);
+    }
   }
   
-  Serial.printf("Enrolling: ID=%d, Name=%s\n", id, name.c_str());
+  Serial.printf("Enrolling: slot=%d, emp_id=%d, Name=%s\n", id, empId ? empId : id, name.c_str());
   
-  display.clearDisplay();
-  display.printf("ID: %d", id);
-  display.setCursor(0, 16);
-  display.println(name);
-  display.setCursor(0, 32);
-  display.println("Place finger...");
-  display.display();
+  frame = textScreen();
+  addScreenLine(frame, 0, 0, 1, "ID: %d", empId ? empId : id);
+  addScreenLine(frame, 0, 16, 1, "%s", name.c_str());
+  addScreenLine(frame, 0, 32, 1, "Place finger...");
+  postScreen(frame);
   
   // Capture first scan
   if (!captureFingerprint(1, "Place finger...", "First scan done")) {
@@ -299,34 +316,34 @@ void enrollFingerprint(int id = -1) {
     return;
   }
   
-  display.println("Processing...");
-  display.display();
+  frame = textScreen();
+  addScreenLine(frame, 0, 0, 1, "Processing...");
+  postScreen(frame);
   
   // Create model
+  uint32_t modelStart = millis();
   if (finger.createModel() != FINGERPRINT_OK) {
     failMessage("Prints don't match");
     return;
   }
   
-  // Store in sensor
+  // Store in sensor; the model stays in CharBuffer1 for the export below
   if (finger.storeModel(id) == FINGERPRINT_OK) {
-    successMessage("Stored as ID: " + String(id));
-    saveFingerprintDB();
+    assignSlot(id, empId ? empId : id);
+    successMessage("Stored as ID: " + String(empId ? empId : id));
+    updateFingerprintDB(id, true);
     
     // Capture and save template with full data for server sync
-    if (captureAndSaveTemplateWithData(id, name)) {
+    bool queued = captureAndSaveTemplateWithData(id, name, true);
+    LOG_I("ENROLL", "Slot %d stored and exported in %lu ms", id, millis() - modelStart);
+    if (queued) {
       Serial.println("✅ Template queued for server upload");
       
-      display.clearDisplay();
-      display.setTextSize(1);
-      display.setCursor(0, 0);
-      display.println("Success!");
-      display.setCursor(0, 20);
-      display.println("Template will be");
-      display.println("synced to server");
-      display.display();
-      buzzerSuccess();
-      delay(2000);
+      frame = textScreen();
+      addScreenLine(frame, 0, 0, 1, "Success!");
+      addScreenLine(frame, 0, 20, 1, "Template will be");
+      addScreenLine(frame, 0, 28, 1, "synced to server");
+      showFeedback(frame, BUZZ_SUCCESS);
     } else {
       Serial.println("⚠️ Failed to queue template for server");
     }
@@ -335,23 +352,20 @@ void enrollFingerprint(int id = -1) {
   }
 }
 void deleteFingerprint(int id) {
-  if (id < 1 || id > 127) {
+  if (id < 1 || id > FINGER_SLOT_COUNT) {
     Serial.println("❗ Invalid ID.");
     buzzerFail();
-    digitalWrite(BUZZER_PIN, LOW);
-    delay(200);
     return;
   }
 
   if (finger.deleteModel(id) == FINGERPRINT_OK) {
     Serial.print("🗑️ Deleted fingerprint ID: ");
     Serial.println(id);
-    saveFingerprintDB();
+    assignSlot(id, 0);
+    updateFingerprintDB(id, false);
   } else {
     Serial.println("❌ Deletion failed.");
     buzzerFail();
-    digitalWrite(BUZZER_PIN, LOW);
-    delay(200);
   }
 }
 void listFingerprints() {
@@ -361,13 +375,11 @@ void listFingerprints() {
   } else {
     Serial.println("⚠️ Failed to get count.");
     buzzerFail();
-    digitalWrite(BUZZER_PIN, LOW);
-    delay(200);
     return;
   }
 
   Serial.print("✅ Found IDs: ");
-  for (int id = 1; id <= 1000; id++) {
+  for (int id = 1; id <= FINGER_SLOT_COUNT; id++) {
     if (finger.loadModel(id) == FINGERPRINT_OK) {
       Serial.print(id);
       Serial.print(" ");
@@ -376,12 +388,43 @@ void listFingerprints() {
   }
   Serial.println();
 }
+// Scan a finger the employee already has enrolled, then enroll another
+// one into the same group
+void addFingerToEmployee() {
+  ScreenFrame frame = textScreen();
+  addScreenLine(frame, 0, 0, 1, "Add finger");
+  addScreenLine(frame, 0, 16, 1, "Scan enrolled finger");
+  postScreen(frame);
+
+  unsigned long start = millis();
+  uint8_t result = finger.getImage();
+  while (result != FINGERPRINT_OK && millis() - start < 10000) {
+    delay(100);
+    result = finger.getImage();
+  }
+  if (result != FINGERPRINT_OK || finger.image2Tz() != FINGERPRINT_OK ||
+      finger.fingerSearch() != FINGERPRINT_OK) {
+    failMessage("Not recognized");
+    return;
+  }
+
+  uint16_t empId = employeeForSlot(finger.fingerID);
+  Serial.printf("Adding finger for emp_id %d (matched slot %d)\n", empId, finger.fingerID);
+
+  addScreenLine(frame, 0, 32, 1, "ID %d: remove finger", empId);
+  postScreen(frame);
+  start = millis();
+  while (finger.getImage() != FINGERPRINT_NOFINGER && millis() - start < 3000) {
+    delay(100);
+  }
+
+  enrollFingerprint(-1, empId);
+}
+
 void startDeleteFingerprintProcess() {
-  display.clearDisplay();
-  display.setTextSize(2);
-  display.setCursor(0, 0);
-  display.print("Scan Finger to Delete");
-  display.display();
+  ScreenFrame frame = textScreen();
+  addScreenLine(frame, 0, 0, 2, "Scan Finger to Delete");
+  postScreen(frame);
   delay(5000);
   if (finger.getImage() == FINGERPRINT_OK && finger.image2Tz() == FINGERPRINT_OK && finger.fingerSearch() == FINGERPRINT_OK) {
     deleteFingerprint(finger.fingerID);
@@ -29,6 +29,12 @@ extern RTC_DS3231 rtc;
 extern HardwareSerial mySerial;
 extern Adafruit_Fingerprint finger;
 
+// Display Task
+extern QueueHandle_t displayQueue;
+extern QueueHandle_t toastQueue;
+extern TaskHandle_t displayTaskHandle;
+extern TaskHandle_t punchWriterHandle;
+
 // Global Variables
 extern String auth_token;
 extern bool menuMode;
@@ -36,6 +42,8 @@ extern int currentMenu;
 extern unsigned long menuStartTime;
 extern unsigned long lastMenuInteraction;
 extern volatile bool fingerTouched;
+extern volatile int64_t fingerTouchUs;
+extern TaskHandle_t inputTaskHandle;
 extern volatile bool buttonPressedFlag;
 extern bool buttonBeingHandled;
 extern unsigned long pressStartTime;
@@ -0,0 +1,130 @@
+#ifndef HEALTH_MONITOR_H
+#define HEALTH_MONITOR_H
+
+#include "config.h"
+#include "globals.h"
+#include "scheduler.h"
+#include "time_service.h"
+#include "log.h"
+#include "esp_heap_caps.h"
+
+// Periodic heap and stack sampling. Every HEALTH_SAMPLE_INTERVAL the job
+// records free heap, the largest free block (what a big String or HTTP
+// buffer actually needs), the all-time heap minimum and the stack
+// high-water marks of the loop, display and punch writer tasks, stamped
+// with the time.
+//
+// A warning is logged once when a value drops below its threshold, and
+// once when the free heap trend over the sample ring would reach the
+// critical level within HEALTH_FORECAST_S, so a slow leak is reported
+// before it resets the device.
+
+struct HealthSample {
+  uint32_t unixTime;
+  uint32_t freeHeap;
+  uint32_t largestBlock;
+  uint32_t minFreeHeap;
+  uint16_t loopStackFree;     // Bytes never touched (ESP-IDF reports bytes)
+  uint16_t displayStackFree;
+  uint16_t writerStackFree;   // Punch writer task
+};
+
+static HealthSample healthSamples[HEALTH_HISTORY];
+static uint8_t healthSampleCount = 0;
+static uint8_t healthSampleHead = 0;
+static uint8_t healthWarnings = 0;  // Bit per condition currently below threshold
+
+enum HealthWarning : uint8_t {
+  HEALTH_WARN_HEAP = 1 << 0,
+  HEALTH_WARN_BLOCK = 1 << 1,
+  HEALTH_WARN_LOOP_STACK = 1 << 2,
+  HEALTH_WARN_DISPLAY_STACK = 1 << 3,
+  HEALTH_WARN_TREND = 1 << 4,
+  HEALTH_WARN_WRITER_STACK = 1 << 5
+};
+
+// True on the sample where the condition first becomes true
+static bool healthRaised(HealthWarning bit, bool condition) {
+  bool wasSet = healthWarnings & bit;
+  if (condition) healthWarnings |= bit;
+  else healthWarnings &= ~bit;
+  return condition && !wasSet;
+}
+
+static const HealthSample &healthOldest() {
+  uint8_t oldest = healthSampleCount < HEALTH_HISTORY ? 0 : healthSampleHead;
+  return healthSamples[oldest];
+}
+
+const HealthSample &healthLatest() {
+  return healthSamples[(healthSampleHead + HEALTH_HISTORY - 1) % HEALTH_HISTORY];
+}
+
+static void healthCheck(const HealthSample &s) {
+  if (healthRaised(HEALTH_WARN_HEAP, s.freeHeap < HEALTH_HEAP_WARN_BYTES)) {
+    LOG_W("HEALTH", "Free heap low: %lu bytes", (unsigned long)s.freeHeap);
+  }
+  if (healthRaised(HEALTH_WARN_BLOCK, s.largestBlock < HEALTH_BLOCK_WARN_BYTES)) {
+    LOG_W("HEALTH", "Heap fragmented: largest block %lu of %lu free",
+          (unsigned long)s.largestBlock, (unsigned long)s.freeHeap);
+  }
+  if (healthRaised(HEALTH_WARN_LOOP_STACK, s.loopStackFree < HEALTH_STACK_WARN_BYTES)) {
+    LOG_W("HEALTH", "Loop stack headroom low: %u bytes", s.loopStackFree);
+  }
+  if (healthRaised(HEALTH_WARN_DISPLAY_STACK, displayTaskHandle && s.displayStackFree < HEALTH_STACK_WARN_BYTES)) {
+    LOG_W("HEALTH", "Display stack headroom low: %u bytes", s.displayStackFree);
+  }
+  if (healthRaised(HEALTH_WARN_WRITER_STACK, punchWriterHandle && s.writerStackFree < HEALTH_STACK_WARN_BYTES)) {
+    LOG_W("HEALTH", "Punch writer stack headroom low: %u bytes", s.writerStackFree);
+  }
+
+  // Linear trend of free heap across the ring
+  const HealthSample &first = healthOldest();
+  uint32_t spanS = s.unixTime - first.unixTime;
+  float secondsLeft = HEALTH_FORECAST_S;
+  float bytesPerS = 0;
+  if (spanS > 0 && s.freeHeap < first.freeHeap) {
+    bytesPerS = (float)(first.freeHeap - s.freeHeap) / spanS;
+    secondsLeft = s.freeHeap > HEALTH_HEAP_CRITICAL_BYTES ? (s.freeHeap - HEALTH_HEAP_CRITICAL_BYTES) / bytesPerS : 0;
+  }
+  if (healthRaised(HEALTH_WARN_TREND, secondsLeft < HEALTH_FORECAST_S)) {
+    LOG_W("HEALTH", "Heap falling %.1f B/min; critical in ~%lu min",
+          bytesPerS * 60, (unsigned long)(secondsLeft / 60));
+  }
+}
+
+// Scheduled every HEALTH_SAMPLE_INTERVAL; runs on the loop task
+JobResult sampleHealth() {
+  HealthSample s;
+  s.unixTime = timeNowUnix();
+  s.freeHeap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  s.largestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+  s.minFreeHeap = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+  s.loopStackFree = uxTaskGetStackHighWaterMark(nullptr);
+  s.displayStackFree = displayTaskHandle ? uxTaskGetStackHighWaterMark(displayTaskHandle) : 0;
+  s.writerStackFree = punchWriterHandle ? uxTaskGetStackHighWaterMark(punchWriterHandle) : 0;
+
+  healthSamples[healthSampleHead] = s;
+  healthSampleHead = (healthSampleHead + 1) % HEALTH_HISTORY;
+  if (healthSampleCount < HEALTH_HISTORY) healthSampleCount++;
+
+  healthCheck(s);
+  return JOB_DONE;
+}
+
+void printHealth() {
+  Serial.println("\n=== Heap / Stack ===");
+  Serial.println("time        free   largest   min-free  loop-stk  disp-stk  wrtr-stk");
+  for (uint8_t i = 0; i < healthSampleCount; i++) {
+    uint8_t idx = (healthSampleHead + HEALTH_HISTORY - healthSampleCount + i) % HEALTH_HISTORY;
+    const HealthSample &s = healthSamples[idx];
+    char clock[TS_CLOCK_LEN];
+    formatClock(clock, s.unixTime);
+    Serial.printf("%s %8lu %9lu %10lu %9u %9u %9u\n", clock, (unsigned long)s.freeHeap,
+                  (unsigned long)s.largestBlock, (unsigned long)s.minFreeHeap,
+                  s.loopStackFree, s.displayStackFree, s.writerStackFree);
+  }
+  Serial.println("====================\n");
+}
+
+#endif
\ No newline at end of file
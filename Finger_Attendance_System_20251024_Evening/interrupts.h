@@ -4,20 +4,30 @@
 #include "config.h"
 #include "globals.h"
 
-// void IRAM_ATTR onFingerTouch() {
-//   fingerTouched = true;
-// }
+// Both interrupts wake the loop task, which owns the sensor, straight out
+// of its sleep in loop() instead of waiting for it to poll the flags.
+static void IRAM_ATTR wakeInputTask() {
+  if (!inputTaskHandle) return;
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(inputTaskHandle, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
 void IRAM_ATTR onFingerTouch() {
-    static unsigned long lastTrigger = 0;
-    unsigned long now = millis();
-    if (now - lastTrigger > 500) {  // 500ms debounce
-        fingerTouched = true;
-        lastTrigger = now;
-    }
+  static int64_t lastTouchUs = 0;
+  int64_t nowUs = esp_timer_get_time();
+  if (nowUs - lastTouchUs < FINGER_TOUCH_DEBOUNCE_US) return;
+  lastTouchUs = nowUs;
+  fingerTouchUs = nowUs;
+  fingerTouched = true;
+  wakeInputTask();
 }
 
 void IRAM_ATTR onButtonPress() {
-  if (!buttonBeingHandled) buttonPressedFlag = true;
+  if (!buttonBeingHandled) {
+    buttonPressedFlag = true;
+    wakeInputTask();
+  }
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,100 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include "config.h"
+
+// Leveled, tagged logging. LOG_LEVEL (config.h) is the compile-time
+// ceiling: calls above it sit behind a constant-false condition and are
+// dropped by the compiler, format strings included. Below that, logLevel
+// can be lowered or raised at run time (e.g. from the server config).
+//
+// Every line that passes is written to Serial and also kept in a RAM ring
+// of the most recent LOG_RING_SIZE bytes, which logDump() prints on demand.
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+#define LOG_LEVEL_VERBOSE 5
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+static volatile uint8_t logLevel = LOG_LEVEL;
+
+#define LOG_ENABLED(level) (LOG_LEVEL >= (level) && logLevel >= (level))
+
+#define LOG_AT(level, tag, fmt, ...) \
+  do { \
+    if (LOG_ENABLED(level)) logWrite(level, tag, fmt, ##__VA_ARGS__); \
+  } while (0)
+
+#define LOG_E(tag, fmt, ...) LOG_AT(LOG_LEVEL_ERROR, tag, fmt, ##__VA_ARGS__)
+#define LOG_W(tag, fmt, ...) LOG_AT(LOG_LEVEL_WARN, tag, fmt, ##__VA_ARGS__)
+#define LOG_I(tag, fmt, ...) LOG_AT(LOG_LEVEL_INFO, tag, fmt, ##__VA_ARGS__)
+#define LOG_D(tag, fmt, ...) LOG_AT(LOG_LEVEL_DEBUG, tag, fmt, ##__VA_ARGS__)
+#define LOG_V(tag, fmt, ...) LOG_AT(LOG_LEVEL_VERBOSE, tag, fmt, ##__VA_ARGS__)
+
+static portMUX_TYPE logMux = portMUX_INITIALIZER_UNLOCKED;
+static char logRing[LOG_RING_SIZE];
+static size_t logRingHead = 0;  // Next write position
+static bool logRingWrapped = false;
+
+static const char LOG_LEVEL_CHARS[] = "-EWIDV";
+
+static void logRingAppend(const char *text, size_t len) {
+  portENTER_CRITICAL(&logMux);
+  for (size_t i = 0; i < len; i++) {
+    logRing[logRingHead++] = text[i];
+    if (logRingHead == LOG_RING_SIZE) {
+      logRingHead = 0;
+      logRingWrapped = true;
+    }
+  }
+  portEXIT_CRITICAL(&logMux);
+}
+
+void logWrite(uint8_t level, const char *tag, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+void logWrite(uint8_t level, const char *tag, const char *fmt, ...) {
+  char line[LOG_LINE_LEN];
+  int len = snprintf(line, sizeof(line), "%c [%s] ", LOG_LEVEL_CHARS[level], tag);
+
+  va_list args;
+  va_start(args, fmt);
+  len += vsnprintf(line + len, sizeof(line) - len, fmt, args);
+  va_end(args);
+
+  // Truncated lines still end with a newline
+  if (len > (int)sizeof(line) - 2) len = sizeof(line) - 2;
+  line[len++] = '\n';
+  line[len] = '\0';
+
+  Serial.write((const uint8_t *)line, len);
+  logRingAppend(line, len);
+}
+
+void logSetLevel(uint8_t level) {
+  logLevel = level > LOG_LEVEL_VERBOSE ? LOG_LEVEL_VERBOSE : level;
+}
+
+void logDump(Print &out) {
+  static char copy[LOG_RING_SIZE];
+  size_t head;
+  bool wrapped;
+
+  portENTER_CRITICAL(&logMux);
+  memcpy(copy, logRing, sizeof(copy));
+  head = logRingHead;
+  wrapped = logRingWrapped;
+  portEXIT_CRITICAL(&logMux);
+
+  out.println("\n=== Device Log ===");
+  if (wrapped) out.write((const uint8_t *)copy + head, LOG_RING_SIZE - head);
+  out.write((const uint8_t *)copy, head);
+  out.println("==================\n");
+}
+
+#endif
\ No newline at end of file
@@ -8,13 +8,15 @@
 #include "wifi_functions.h"
 #include "utility_functions.h"
 #include "template_functions.h"  // ADD THIS
+#include "template_export.h"
+#include "template_dedup.h"
+#include "log.h"
 
 void exitMenuMode() {
   Serial.println("⏳ Menu timeout - exiting.");
   menuMode = false;
   currentMenu = 0;
-  display.clearDisplay();
-  display.display();
+  updateDisplay();
   delay(100);
 }
 
@@ -35,9 +37,15 @@ void executeMenuAction() {
       break;
     case 4:  // List Fingerprints
       listFingerprints();
+      listTemplateFiles();
       break;
     case 5:  // Show Logs
       showLastLogs();
+      logDump(Serial);
+      printPunchMetrics();
+      printHealth();
+      printRecognitionReport();
+      printPacketStats();
       break;
     case 2:  // Export Template (NEW)
       exportAllTemplates();
@@ -48,12 +56,18 @@ void executeMenuAction() {
     case 6:  // Set WiFi (moved from 4 to 6)
       enterConfigMode();
       break;
-    case 7:  // Exit (moved from 5 to 7)
+    case 7:  // Add another finger to an enrolled employee
+      addFingerToEmployee();
+      break;
+    case 8:  // Merge fingers enrolled twice
+      dedupScanLibrary();
+      break;
+    case 9:  // Exit (always last)
       Serial.println("Exiting menu");
       break;
   }
 
-  if (currentMenu != 7) { // Updated from 5 to 7
+  if (currentMenu != menuCount - 1) {
     buzzerSuccess();
     delay(500);
     showButtonMenu();
@@ -0,0 +1,177 @@
+#ifndef PUNCH_METRICS_H
+#define PUNCH_METRICS_H
+
+#include "config.h"
+#include "globals.h"
+#include "health_monitor.h"
+
+// Per-stage latency histograms for the punch path, from the touch
+// interrupt to the pending-queue write. Each stage keeps fixed buckets in
+// RAM; printPunchMetrics() summarises them on Serial and GET /metrics
+// serves them, plus the latest heap/stack sample, in Prometheus text
+// format so builds can be compared in the field.
+//
+// Each stage is recorded by a single task (the SD stages by the punch
+// writer, the rest by the loop task) and /metrics is served from its own
+// task, so the histograms need no locking; a reader may see a stage
+// mid-update.
+
+enum PunchStage : uint8_t {
+  STAGE_TOUCH_PICKUP,      // Touch interrupt to loop() noticing it
+  STAGE_TOUCH_TO_CAPTURE,  // Touch interrupt to first usable image
+  STAGE_GET_IMAGE,
+  STAGE_IMAGE2TZ,
+  STAGE_SEARCH,
+  STAGE_DISPLAY,           // Result screen and buzzer handed off
+  STAGE_LOG_LOCAL,         // attendance.csv append
+  STAGE_LOG_PENDING,       // Upload queue append
+  STAGE_TOTAL,             // Touch interrupt to punch handed off
+  STAGE_COUNT
+};
+
+static const char *const PUNCH_STAGE_NAMES[STAGE_COUNT] = {
+  "touch_pickup", "touch_to_capture", "get_image", "image2tz", "search",
+  "display", "log_local", "log_pending", "total"
+};
+
+// Bucket upper bounds in milliseconds; the last bucket catches the rest
+static const uint16_t PUNCH_BUCKET_MS[] = { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000 };
+const uint8_t PUNCH_BUCKET_COUNT = sizeof(PUNCH_BUCKET_MS) / sizeof(PUNCH_BUCKET_MS[0]) + 1;
+
+struct StageHistogram {
+  uint32_t count;
+  uint64_t sumUs;
+  uint32_t maxUs;
+  uint32_t buckets[PUNCH_BUCKET_COUNT];
+};
+
+static StageHistogram punchHistograms[STAGE_COUNT];
+
+void metricsRecord(PunchStage stage, uint32_t us) {
+  StageHistogram &h = punchHistograms[stage];
+  uint8_t b = 0;
+  while (b < PUNCH_BUCKET_COUNT - 1 && us > PUNCH_BUCKET_MS[b] * 1000UL) b++;
+  h.buckets[b]++;
+  h.count++;
+  h.sumUs += us;
+  if (us > h.maxUs) h.maxUs = us;
+}
+
+void metricsRecordSince(PunchStage stage, int64_t startUs) {
+  metricsRecord(stage, (uint32_t)(esp_timer_get_time() - startUs));
+}
+
+// Upper bound (ms) of the bucket holding the q-th quantile; 0 if empty
+static uint32_t metricsQuantileMs(const StageHistogram &h, float q) {
+  if (h.count == 0) return 0;
+  uint32_t target = (uint32_t)(q * h.count + 0.5f);
+  if (target == 0) target = 1;
+  uint32_t seen = 0;
+  for (uint8_t b = 0; b < PUNCH_BUCKET_COUNT - 1; b++) {
+    seen += h.buckets[b];
+    if (seen >= target) return PUNCH_BUCKET_MS[b];
+  }
+  return h.maxUs / 1000;
+}
+
+void printPunchMetrics() {
+  Serial.println("\n=== Punch Latency (ms) ===");
+  Serial.println("stage           count     mean    p50    p90    p99      max");
+  for (uint8_t s = 0; s < STAGE_COUNT; s++) {
+    const StageHistogram &h = punchHistograms[s];
+    if (h.count == 0) continue;
+    Serial.printf("%-14s %6lu %8.1f %6lu %6lu %6lu %8.1f\n", PUNCH_STAGE_NAMES[s],
+                  (unsigned long)h.count, h.sumUs / 1000.0 / h.count,
+                  (unsigned long)metricsQuantileMs(h, 0.5f), (unsigned long)metricsQuantileMs(h, 0.9f),
+                  (unsigned long)metricsQuantileMs(h, 0.99f), h.maxUs / 1000.0);
+  }
+  Serial.println("==========================\n");
+}
+
+// GET /metrics, Prometheus text exposition format
+void handleMetrics() {
+  char line[256];
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/plain; version=0.0.4", "");
+
+  snprintf(line, sizeof(line), "punch_build_info{device=\"%s\",build=\"%s %s\"} 1\n",
+           device_id.c_str(), __DATE__, __TIME__);
+  server.sendContent(line);
+  server.sendContent("# TYPE punch_stage_seconds histogram\n");
+
+  for (uint8_t s = 0; s < STAGE_COUNT; s++) {
+    const StageHistogram &h = punchHistograms[s];
+    const char *name = PUNCH_STAGE_NAMES[s];
+    uint32_t cumulative = 0;
+    for (uint8_t b = 0; b < PUNCH_BUCKET_COUNT - 1; b++) {
+      cumulative += h.buckets[b];
+      snprintf(line, sizeof(line), "punch_stage_seconds_bucket{stage=\"%s\",le=\"%g\"} %lu\n",
+               name, PUNCH_BUCKET_MS[b] / 1000.0, (unsigned long)cumulative);
+      server.sendContent(line);
+    }
+    snprintf(line, sizeof(line),
+             "punch_stage_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %lu\n"
+             "punch_stage_seconds_sum{stage=\"%s\"} %.6f\n"
+             "punch_stage_seconds_count{stage=\"%s\"} %lu\n",
+             name, (unsigned long)h.count, name, h.sumUs / 1e6, name, (unsigned long)h.count);
+    server.sendContent(line);
+  }
+
+  server.sendContent("# TYPE punch_stage_max_seconds gauge\n");
+  for (uint8_t s = 0; s < STAGE_COUNT; s++) {
+    snprintf(line, sizeof(line), "punch_stage_max_seconds{stage=\"%s\"} %.6f\n",
+             PUNCH_STAGE_NAMES[s], punchHistograms[s].maxUs / 1e6);
+    server.sendContent(line);
+  }
+
+  if (healthSampleCount > 0) {
+    const HealthSample &s = healthLatest();
+    snprintf(line, sizeof(line),
+             "heap_free_bytes %lu\nheap_largest_block_bytes %lu\nheap_min_free_bytes %lu\n"
+             "stack_free_bytes{task=\"loop\"} %u\nstack_free_bytes{task=\"display\"} %u\n"
+             "stack_free_bytes{task=\"punch_writer\"} %u\n",
+             (unsigned long)s.freeHeap, (unsigned long)s.largestBlock, (unsigned long)s.minFreeHeap,
+             s.loopStackFree, s.displayStackFree, s.writerStackFree);
+    server.sendContent(line);
+  }
+  server.sendContent("");
+}
+
+// The web server is polled by one task at a time: this one, except while
+// enterConfigMode() holds it between metricsPause() and metricsResume()
+static SemaphoreHandle_t serverMutex = nullptr;
+
+// Polls the web server off the loop task, which would otherwise be woken
+// every METRICS_POLL_INTERVAL instead of sleeping until a touch or a job
+static void metricsTask(void *arg) {
+  for (;;) {
+    xSemaphoreTake(serverMutex, portMAX_DELAY);
+    server.handleClient();
+    xSemaphoreGive(serverMutex);
+    vTaskDelay(pdMS_TO_TICKS(METRICS_POLL_INTERVAL));
+  }
+}
+
+// Serve /metrics on the station interface
+void metricsBegin() {
+  if (serverMutex) return;
+  serverMutex = xSemaphoreCreateMutex();
+  server.on("/metrics", HTTP_GET, handleMetrics);
+  server.begin();
+  xTaskCreatePinnedToCore(metricsTask, "metrics", METRICS_TASK_STACK, nullptr,
+                          METRICS_TASK_PRIORITY, nullptr, METRICS_TASK_CORE);
+}
+
+// Hands the web server to the caller; waits out a request in progress
+void metricsPause() {
+  if (serverMutex) xSemaphoreTake(serverMutex, portMAX_DELAY);
+}
+
+// Takes the web server back after the caller stopped it
+void metricsResume() {
+  if (!serverMutex) return;
+  server.begin();
+  xSemaphoreGive(serverMutex);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,93 @@
+#ifndef PUNCH_PIPELINE_H
+#define PUNCH_PIPELINE_H
+
+#include "config.h"
+#include "globals.h"
+#include "sd_functions.h"
+#include "time_service.h"
+
+// Hands matched punches to a writer task so the loop task can re-arm the
+// sensor as soon as a finger is identified. The result screen and buzzer
+// are already asynchronous (display task, buzzer timer); with the SD
+// writes moved here, checkAttendance() returns right after the search.
+//
+// Time and time quality are captured at match time, so a punch that
+// waits in the queue is still logged with the moment it happened.
+
+struct PunchRecord {
+  uint16_t fingerID;
+  uint32_t unixTime;
+  TimeQuality quality;
+  char name[24];
+};
+
+// Last punch per employee, for suppressing repeats inside the window.
+// Loop task only (recordAttendance and the server config both run there).
+struct RecentPunch {
+  uint16_t fingerID;  // 0 = free slot
+  unsigned long atMs;
+};
+
+static RecentPunch recentPunches[DUPLICATE_CACHE_SIZE];
+static unsigned long duplicateWindowMs = DUPLICATE_WINDOW_S * 1000UL;
+
+// True if fingerID punched within the window; otherwise remembers this punch
+bool isDuplicatePunch(uint16_t fingerID) {
+  unsigned long now = millis();
+  RecentPunch *slot = &recentPunches[0];
+  for (int i = 0; i < DUPLICATE_CACHE_SIZE; i++) {
+    RecentPunch &p = recentPunches[i];
+    if (p.fingerID == fingerID) {
+      if (now - p.atMs < duplicateWindowMs) return true;
+      slot = &p;
+      break;
+    }
+    // Otherwise reuse a free slot, or the oldest entry
+    if (slot->fingerID != 0 && (p.fingerID == 0 || now - p.atMs > now - slot->atMs)) slot = &p;
+  }
+  slot->fingerID = fingerID;
+  slot->atMs = now;
+  return false;
+}
+
+// Server config duplicate_window, in seconds; 0 disables suppression
+void setDuplicateWindow(unsigned long seconds) {
+  duplicateWindowMs = min(seconds, MAX_DUPLICATE_WINDOW_S) * 1000UL;
+}
+
+static QueueHandle_t punchQueue = nullptr;
+
+static void writePunch(const PunchRecord &punch) {
+  logAttendance(punch.fingerID, punch.name, punch.unixTime, punch.quality);
+}
+
+static void punchWriterTask(void *param) {
+  PunchRecord punch;
+  for (;;) {
+    if (xQueueReceive(punchQueue, &punch, portMAX_DELAY) == pdTRUE) {
+      writePunch(punch);
+    }
+  }
+}
+
+// Queue a punch for logging; written inline if the writer is missing or backed up
+void submitPunch(int fingerID, const char *name) {
+  PunchRecord punch;
+  punch.fingerID = fingerID;
+  punch.unixTime = timeNowUnix();
+  punch.quality = timeQuality();
+  snprintf(punch.name, sizeof(punch.name), "%s", name);
+
+  if (punchQueue && xQueueSend(punchQueue, &punch, 0) == pdTRUE) return;
+  Serial.println("Punch queue full - writing inline");
+  writePunch(punch);
+}
+
+void startPunchWriter() {
+  pendingFileMutex = xSemaphoreCreateMutex();
+  punchQueue = xQueueCreate(PUNCH_QUEUE_LEN, sizeof(PunchRecord));
+  xTaskCreatePinnedToCore(punchWriterTask, "punchWriter", PUNCH_WRITER_STACK, nullptr,
+                          PUNCH_WRITER_PRIORITY, &punchWriterHandle, PUNCH_WRITER_CORE);
+}
+
+#endif
\ No newline at end of file
@@ -3,27 +3,117 @@
 
 #include "config.h"
 #include "globals.h"
+#include "time_service.h"
+#include "esp_sntp.h"
 
-void syncRTCTime() {
-  if (wifiConnected) {
-    static unsigned long lastRtcSync = 0;
-    const unsigned long syncInterval = 3600000;
-
-    if (millis() - lastRtcSync > syncInterval || lastRtcSync == 0) {
-      struct tm timeinfo;
-      if (getLocalTime(&timeinfo)) {
-        rtc.adjust(DateTime(
-          timeinfo.tm_year + 1900,
-          timeinfo.tm_mon + 1,
-          timeinfo.tm_mday,
-          timeinfo.tm_hour,
-          timeinfo.tm_min,
-          timeinfo.tm_sec));
-        Serial.println("✅ RTC updated from NTP.");
-        lastRtcSync = millis();
-      }
+// NTP discipline for the RTC. SNTP runs in the background (started by
+// configTime in initWiFi) and calls syncRTCTime() from the network stack
+// each time it sets the system clock, so nothing on loop() waits for it.
+// Each sync measures the offset of our clock against NTP and the drift
+// since the previous sync; the SNTP interval is then stretched or
+// shortened so the expected error stays around TIME_TARGET_ERROR_MS.
+
+struct TimeSyncRecord {
+  uint32_t unixTime;  // When the sync happened (local time)
+  int32_t offsetMs;   // NTP minus our clock
+  float driftPpm;     // Since the previous sync; 0 for the first
+  bool adjusted;      // RTC was rewritten
+};
+
+static TimeSyncRecord timeSyncHistory[TIME_SYNC_HISTORY];
+static uint8_t timeSyncCount = 0;
+static int32_t timeSyncResidualMs = 0;  // Offset left uncorrected at the last sync
+static uint32_t timeSyncIntervalMs = RTC_SYNC_INTERVAL;
+static esp_timer_handle_t rtcWriteTimer = nullptr;
+static volatile uint32_t rtcWriteUnix = 0;
+
+// Fires on the next whole second so the RTC is written in phase with NTP
+static void onRtcWriteTimer(void *arg) {
+  timeSet(DateTime(rtcWriteUnix));
+  Serial.println("✅ RTC updated from NTP.");
+}
+
+static void recordTimeSync(const TimeSyncRecord &rec) {
+  timeSyncHistory[timeSyncCount % TIME_SYNC_HISTORY] = rec;
+  timeSyncCount++;
+}
+
+static void adaptSyncInterval(float driftPpm) {
+  float absPpm = driftPpm < 0 ? -driftPpm : driftPpm;
+  if (absPpm < 0.01f) absPpm = 0.01f;
+
+  // Error grows by driftPpm microseconds per second. Clamped as a float:
+  // a small drift gives more milliseconds than an unsigned long holds.
+  float ms = TIME_TARGET_ERROR_MS * 1000.0f / absPpm * 1000.0f;
+  ms = constrain(ms, (float)TIME_SYNC_MIN_INTERVAL, (float)TIME_SYNC_MAX_INTERVAL);
+  unsigned long intervalMs = (unsigned long)ms;
+  if (intervalMs != timeSyncIntervalMs) {
+    timeSyncIntervalMs = intervalMs;
+    sntp_set_sync_interval(intervalMs);
+  }
+}
+
+// SNTP sync notification; runs in the network stack's task
+void syncRTCTime(struct timeval *tv) {
+  // The RTC keeps local time
+  int64_t ntpUs = (int64_t)(tv->tv_sec + gmtOffset_sec + daylightOffset_sec) * 1000000 + tv->tv_usec;
+  int64_t localUs = timeNowUs();
+  int32_t offsetMs = (int32_t)((ntpUs - localUs) / 1000);
+
+  TimeSyncRecord rec = {};
+  rec.unixTime = (uint32_t)(ntpUs / 1000000);
+  rec.offsetMs = offsetMs;
+
+  if (timeSyncCount > 0) {
+    const TimeSyncRecord &prev = timeSyncHistory[(timeSyncCount - 1) % TIME_SYNC_HISTORY];
+    uint32_t elapsedS = rec.unixTime - prev.unixTime;
+    if (elapsedS > 0) {
+      rec.driftPpm = (float)(offsetMs - timeSyncResidualMs) * 1000.0f / elapsedS;
+      adaptSyncInterval(rec.driftPpm);
     }
   }
+
+  rec.adjusted = abs(offsetMs) >= TIME_ADJUST_THRESHOLD_MS;
+  if (rec.adjusted) {
+    // Write the RTC at the next NTP second boundary
+    int64_t toBoundaryUs = 1000000 - (ntpUs % 1000000);
+    rtcWriteUnix = (uint32_t)(ntpUs / 1000000) + 1;
+    esp_timer_stop(rtcWriteTimer);
+    esp_timer_start_once(rtcWriteTimer, toBoundaryUs);
+    timeSyncResidualMs = 0;
+  } else {
+    timeSyncResidualMs = offsetMs;
+  }
+
+  recordTimeSync(rec);
+  timeMarkSynced();
+  Serial.printf("NTP sync: offset %ld ms, drift %.2f ppm, next in %lu s%s\n",
+                (long)offsetMs, rec.driftPpm, timeSyncIntervalMs / 1000,
+                rec.adjusted ? ", adjusting RTC" : "");
+}
+
+// Call before configTime(); SNTP then reports every sync to syncRTCTime()
+void timeSyncBegin() {
+  esp_timer_create_args_t args = {};
+  args.callback = onRtcWriteTimer;
+  args.dispatch_method = ESP_TIMER_TASK;
+  args.name = "rtcWrite";
+  esp_timer_create(&args, &rtcWriteTimer);
+
+  sntp_set_time_sync_notification_cb(syncRTCTime);
+  sntp_set_sync_interval(timeSyncIntervalMs);
+}
+
+void printTimeSyncHistory() {
+  Serial.println("\n=== NTP Sync History ===");
+  Serial.printf("Quality: %s, interval: %lu s\n", timeQualityName(timeQuality()), timeSyncIntervalMs / 1000);
+  uint8_t count = min((int)timeSyncCount, TIME_SYNC_HISTORY);
+  for (uint8_t i = 0; i < count; i++) {
+    const TimeSyncRecord &rec = timeSyncHistory[(timeSyncCount - count + i) % TIME_SYNC_HISTORY];
+    Serial.printf("%lu: offset %ld ms, drift %.2f ppm%s\n", (unsigned long)rec.unixTime,
+                  (long)rec.offsetMs, rec.driftPpm, rec.adjusted ? " (adjusted)" : "");
+  }
+  Serial.println("========================\n");
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,193 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "config.h"
+#include "globals.h"
+
+// Cooperative scheduler for the background jobs that loop() used to poll
+// with their own `static unsigned long last...` timers. loop() calls
+// schedulerRun() on every pass; it returns after a single compare until
+// the earliest deadline has passed, then runs the most overdue job.
+//
+// A job returns JOB_RETRY to be re-run after a back-off delay instead of
+// its normal interval. By default the delay starts at retryMs and doubles
+// per consecutive failure, capped at the job interval; a job may supply
+// its own BackoffFunction instead.
+
+enum JobResult : uint8_t {
+  JOB_DONE,
+  JOB_RETRY
+};
+
+typedef JobResult (*JobFunction)();
+typedef unsigned long (*BackoffFunction)(uint8_t failures);
+
+struct SchedulerJob {
+  const char *name;
+  JobFunction fn;
+  unsigned long intervalMs;  // 0 = one-shot
+  unsigned long jitterMs;
+  unsigned long retryMs;     // 0 = retry on the normal interval
+  BackoffFunction backoff;
+  unsigned long dueAt;
+  uint8_t failures;
+  bool active;
+  // Profiling
+  uint32_t runs;
+  uint32_t lastRunUs;
+  uint32_t maxRunUs;
+};
+
+static SchedulerJob schedulerJobs[SCHEDULER_MAX_JOBS];
+static unsigned long schedulerNextDue = 0;
+
+static bool schedulerIsDue(unsigned long dueAt, unsigned long now) {
+  return (long)(now - dueAt) >= 0;
+}
+
+static void schedulerUpdateNextDue() {
+  unsigned long now = millis();
+  unsigned long earliest = now + SCHEDULER_IDLE_CHECK_MS;
+  for (int i = 0; i < SCHEDULER_MAX_JOBS; i++) {
+    const SchedulerJob &job = schedulerJobs[i];
+    if (job.active && (long)(job.dueAt - earliest) < 0) earliest = job.dueAt;
+  }
+  schedulerNextDue = earliest;
+}
+
+static unsigned long schedulerRetryDelay(const SchedulerJob &job) {
+  if (job.backoff) return job.backoff(job.failures);
+
+  unsigned long cap = job.intervalMs ? job.intervalMs : SCHEDULER_MAX_BACKOFF_MS;
+  if (job.retryMs == 0) return cap;
+  uint8_t shift = job.failures > 1 ? min((int)job.failures - 1, 16) : 0;
+  unsigned long delayMs = job.retryMs << shift;
+  return (delayMs > cap || delayMs < job.retryMs) ? cap : delayMs;
+}
+
+static int schedulerAdd(const char *name, JobFunction fn, unsigned long intervalMs,
+                        unsigned long firstDelayMs, unsigned long jitterMs,
+                        unsigned long retryMs, BackoffFunction backoff) {
+  for (int i = 0; i < SCHEDULER_MAX_JOBS; i++) {
+    SchedulerJob &job = schedulerJobs[i];
+    if (job.active) continue;
+    job = SchedulerJob();
+    job.name = name;
+    job.fn = fn;
+    job.intervalMs = intervalMs;
+    job.jitterMs = jitterMs;
+    job.retryMs = retryMs;
+    job.backoff = backoff;
+    job.dueAt = millis() + firstDelayMs;
+    job.active = true;
+    schedulerUpdateNextDue();
+    return i;
+  }
+  Serial.printf("Scheduler full - cannot add job %s\n", name);
+  return -1;
+}
+
+int schedulerAddPeriodic(const char *name, JobFunction fn, unsigned long intervalMs,
+                         unsigned long firstDelayMs = 0, unsigned long jitterMs = 0,
+                         unsigned long retryMs = 0, BackoffFunction backoff = nullptr) {
+  return schedulerAdd(name, fn, intervalMs, firstDelayMs, jitterMs, retryMs, backoff);
+}
+
+int schedulerAddOnce(const char *name, JobFunction fn, unsigned long delayMs = 0,
+                     unsigned long retryMs = 0, BackoffFunction backoff = nullptr) {
+  return schedulerAdd(name, fn, 0, delayMs, 0, retryMs, backoff);
+}
+
+// Change a periodic job's interval at runtime (e.g. sync_interval from the server)
+bool schedulerSetInterval(JobFunction fn, unsigned long intervalMs) {
+  for (int i = 0; i < SCHEDULER_MAX_JOBS; i++) {
+    SchedulerJob &job = schedulerJobs[i];
+    if (!job.active || job.fn != fn || job.intervalMs == 0) continue;
+    job.intervalMs = intervalMs;
+    unsigned long latest = millis() + intervalMs;
+    if ((long)(job.dueAt - latest) > 0) job.dueAt = latest;
+    schedulerUpdateNextDue();
+    return true;
+  }
+  return false;
+}
+
+// Run the job immediately on the next pass
+bool schedulerTrigger(JobFunction fn) {
+  for (int i = 0; i < SCHEDULER_MAX_JOBS; i++) {
+    SchedulerJob &job = schedulerJobs[i];
+    if (!job.active || job.fn != fn) continue;
+    job.dueAt = millis();
+    schedulerNextDue = job.dueAt;
+    return true;
+  }
+  return false;
+}
+
+// Stop a job; safe to call from inside the job itself
+bool schedulerCancel(JobFunction fn) {
+  for (int i = 0; i < SCHEDULER_MAX_JOBS; i++) {
+    SchedulerJob &job = schedulerJobs[i];
+    if (!job.active || job.fn != fn) continue;
+    job.active = false;
+    return true;
+  }
+  return false;
+}
+
+// How long loop() may sleep before the next job is due
+unsigned long schedulerMsUntilDue() {
+  long remaining = (long)(schedulerNextDue - millis());
+  return remaining > 0 ? remaining : 0;
+}
+
+void schedulerRun() {
+  unsigned long now = millis();
+  if (!schedulerIsDue(schedulerNextDue, now)) return;
+
+  // Pick the most overdue job; one job per pass keeps loop() responsive
+  SchedulerJob *next = nullptr;
+  for (int i = 0; i < SCHEDULER_MAX_JOBS; i++) {
+    SchedulerJob &job = schedulerJobs[i];
+    if (!job.active || !schedulerIsDue(job.dueAt, now)) continue;
+    if (!next || (long)(job.dueAt - next->dueAt) < 0) next = &job;
+  }
+
+  if (next) {
+    SchedulerJob &job = *next;
+    unsigned long startUs = micros();
+    JobResult result = job.fn();
+    job.lastRunUs = micros() - startUs;
+    if (job.lastRunUs > job.maxRunUs) job.maxRunUs = job.lastRunUs;
+    job.runs++;
+
+    unsigned long delayMs;
+    if (result == JOB_RETRY) {
+      if (job.failures < 255) job.failures++;
+      delayMs = schedulerRetryDelay(job);
+    } else {
+      job.failures = 0;
+      delayMs = job.intervalMs;
+      if (job.intervalMs == 0) job.active = false;
+    }
+    if (job.jitterMs) delayMs += random(job.jitterMs + 1);
+    job.dueAt = millis() + delayMs;
+  }
+
+  schedulerUpdateNextDue();
+}
+
+void schedulerPrintStats() {
+  Serial.println("\n=== Scheduler Jobs ===");
+  unsigned long now = millis();
+  for (int i = 0; i < SCHEDULER_MAX_JOBS; i++) {
+    const SchedulerJob &job = schedulerJobs[i];
+    if (!job.active) continue;
+    Serial.printf("%-20s every %7lu ms, due in %7ld ms, runs %5lu, last %7lu us, max %7lu us, failures %u\n",
+                  job.name, job.intervalMs, (long)(job.dueAt - now), (unsigned long)job.runs,
+                  (unsigned long)job.lastRunUs, (unsigned long)job.maxRunUs, job.failures);
+  }
+  Serial.println("======================\n");
+}
+
+#endif
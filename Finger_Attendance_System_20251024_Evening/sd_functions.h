@@ -4,6 +4,8 @@
 #include "config.h"
 #include "globals.h"
 #include "utility_functions.h"  // ADD THIS LINE
+#include "time_service.h"
+#include "punch_metrics.h"
 
 // Basic SD Card Functions
 bool saveToSD(const String &filename, const String &data) {
@@ -48,6 +50,18 @@ bool appendToSD(const String &filename, const String &data) {
   return false;
 }
 
+// Buffer variant for hot paths that must not allocate
+bool appendToSD(const char *filename, const char *data, size_t len) {
+  File file = SD.open(filename, FILE_APPEND);
+  if (!file) {
+    Serial.printf("Failed to open file for appending: %s\n", filename);
+    return false;
+  }
+  bool ok = file.write((const uint8_t *)data, len) == len;
+  file.close();
+  return ok;
+}
+
 bool deleteFromSD(const String &filename) {
   return SD.remove(filename);
 }
@@ -101,16 +115,36 @@ WiFiConfig loadWiFiConfig() {
 }
 
 // Fingerprint Database
+uint16_t employeeForSlot(uint16_t slot);  // employee_groups.h
+
 bool saveFingerprintDB() {
   String data;
-  for (int id = 1; id <= 300; id++) {
+  for (int id = 1; id <= FINGER_SLOT_COUNT; id++) {
     if (finger.loadModel(id) == FINGERPRINT_OK) {
-      data += String(id) + "," + getNameByID(id) + "\n";
+      data += String(id) + "," + getNameByID(employeeForSlot(id)) + "\n";
     }
   }
   return saveToSD("/fingerprint_db.csv", data);
 }
 
+// Rewrites one slot's line of the directory; no sensor traffic, unlike
+// saveFingerprintDB(), which probes every slot
+bool updateFingerprintDB(uint16_t slot, bool present) {
+  String content = readFromSD("/fingerprint_db.csv");
+  String prefix = String(slot) + ",";
+  String data;
+  int startPos = 0;
+  while (startPos < content.length()) {
+    int endPos = content.indexOf('\n', startPos);
+    if (endPos == -1) endPos = content.length();
+    String line = content.substring(startPos, endPos);
+    if (line.length() && !line.startsWith(prefix)) data += line + "\n";
+    startPos = endPos + 1;
+  }
+  if (present) data += prefix + getNameByID(employeeForSlot(slot)) + "\n";
+  return saveToSD("/fingerprint_db.csv", data);
+}
+
 void loadFingerprintDB() {
   String content = readFromSD("/fingerprint_db.csv");
   if (content.length() == 0) return;
@@ -129,22 +163,44 @@ void loadFingerprintDB() {
   }
 }
 
-// Attendance Logging
-void logAttendance(int fingerID, const String &name) {
-  DateTime now = rtc.now();
-  String timestamp = String(now.year()) + "-" + (now.month() < 10 ? "0" : "") + String(now.month()) + "-" + (now.day() < 10 ? "0" : "") + String(now.day()) + " " + (now.hour() < 10 ? "0" : "") + String(now.hour()) + ":" + (now.minute() < 10 ? "0" : "") + String(now.minute()) + ":" + (now.second() < 10 ? "0" : "") + String(now.second());
+// The punch writer task appends to the pending queue while the sync job
+// drains it on the loop task; this guards the hand-over between them
+static SemaphoreHandle_t pendingFileMutex = nullptr;
+
+void lockPendingFile() {
+  if (pendingFileMutex) xSemaphoreTake(pendingFileMutex, portMAX_DELAY);
+}
+
+void unlockPendingFile() {
+  if (pendingFileMutex) xSemaphoreGive(pendingFileMutex);
+}
+
+// Attendance Logging; unixTime and quality are taken when the finger matched
+void logAttendance(int fingerID, const char *name, uint32_t unixTime, TimeQuality quality) {
+  char timestamp[TS_ISO_LEN];
+  char entry[96];
 
-  String localEntry = String(fingerID) + "," + name + "," + timestamp + "\n";
-  if (!appendToSD("/attendance.csv", localEntry)) {
+  int64_t stageStart = esp_timer_get_time();
+  formatLogTimestamp(timestamp, unixTime);
+  int len = snprintf(entry, sizeof(entry), "%d,%s,%s\n", fingerID, name, timestamp);
+  if (!appendToSD("/attendance.csv", entry, min(len, (int)sizeof(entry) - 1))) {
     Serial.println("Error saving to local log");
   }
+  metricsRecordSince(STAGE_LOG_LOCAL, stageStart);
 
-  String pendingEntry = String(fingerID) + "," + timestamp + "\n";
-  if (!appendToSD(PENDING_ATTENDANCE_FILE, pendingEntry)) {
+  // The upload queue stores the server's ISO form directly
+  stageStart = esp_timer_get_time();
+  formatIsoTimestamp(timestamp, unixTime);
+  len = snprintf(entry, sizeof(entry), "%d,%s,%s\n", fingerID, timestamp, timeQualityName(quality));
+  lockPendingFile();
+  bool queued = appendToSD(PENDING_ATTENDANCE_FILE.c_str(), entry, len);
+  unlockPendingFile();
+  if (!queued) {
     Serial.println("Error saving to pending queue");
   }
+  metricsRecordSince(STAGE_LOG_PENDING, stageStart);
 
-  Serial.printf("Logged: ID %d at %s\n", fingerID, timestamp.c_str());
+  Serial.printf("Logged: ID %d at %s\n", fingerID, timestamp);
 }
 
 String getAttendanceLogs(int maxEntries = 10) {
@@ -174,18 +230,14 @@ void showLastLogs() {
   if (logs.length() == 0) {
     Serial.println("⚠️ No attendance logs found.");
     buzzerFail();
-    digitalWrite(BUZZER_PIN, LOW);
-    delay(200);
     return;
   }
 
   Serial.println("📋 Last Attendance Logs:");
   Serial.println(logs);
 
-  display.clearDisplay();
-  display.setTextSize(1);
-  display.setCursor(0, 0);
-  display.println("Last Attendance:");
+  ScreenFrame frame = textScreen();
+  addScreenLine(frame, 0, 0, 1, "Last Attendance:");
 
   int lineCount = 0;
   int startPos = 0;
@@ -194,18 +246,20 @@ void showLastLogs() {
     if (endPos == -1) endPos = logs.length();
     String line = logs.substring(startPos, endPos);
     if (line.length() > 1) {
-      display.setCursor(0, 16 + (lineCount * 16));
-      display.println(line);
+      addScreenLine(frame, 0, 16 + (lineCount * 16), 1, "%s", line.c_str());
       lineCount++;
     }
     startPos = endPos + 1;
   }
-  display.display();
+  postScreen(frame);
 }
 
 // Pending Records
 bool savePendingAttendance(const String &record) {
-  if (!appendToSD(PENDING_ATTENDANCE_FILE, record + "\n")) {
+  lockPendingFile();
+  bool ok = appendToSD(PENDING_ATTENDANCE_FILE, record + "\n");
+  unlockPendingFile();
+  if (!ok) {
     Serial.println("Failed to save pending attendance");
     return false;
   }
@@ -213,7 +267,7 @@ bool savePendingAttendance(const String &record) {
 }
 
 int getPendingRecordCount() {
-  String content = readFromSD(PENDING_ATTENDANCE_FILE);
+  String content = readFromSD(PENDING_ATTENDANCE_INFLIGHT_FILE) + readFromSD(PENDING_ATTENDANCE_FILE);
   if (content.length() == 0) return 0;
   int count = 0;
   int pos = 0;
@@ -1,13 +1,25 @@
 #ifndef SERVER_COMMUNICATION_H
 #define SERVER_COMMUNICATION_H
 
+#include <WiFiClientSecure.h>
 #include "config.h"
 #include "globals.h"
 #include "sd_functions.h"
+#include "scheduler.h"
+#include "log.h"
+#include "punch_pipeline.h"
+#include "template_pack.h"
+
+JobResult processPendingAttendances();
+
+// Templates are uploaded raw unless the server config asks for "rle"
+static bool templateUploadEncoded = false;
 
 // ===== Server Communication Functions =====
+// Request URLs, payloads and response bodies log at DEBUG; full JSON
+// dumps at VERBOSE. Outcomes log at INFO and failures at WARN/ERROR.
 bool getToken(const String &device_id, const String &default_token) {
-  Serial.println("[AUTH] Attempting to get token...");
+  LOG_I("AUTH", "Attempting to get token...");
 
   HTTPClient http;
   http.setTimeout(10000);
@@ -15,18 +27,15 @@ bool getToken(const String &device_id, const String &default_token) {
   String url = base_url + "/attendify/api/get_token";
   String payload = "{\"dev_id\":\"" + device_id + "\",\"p_token\":\"" + default_token + "\"}";
   
-  Serial.print("[AUTH] URL: ");
-  Serial.println(url);
-  Serial.print("[AUTH] Payload: ");
-  Serial.println(payload);
+  LOG_D("AUTH", "URL: %s", url.c_str());
+  LOG_D("AUTH", "Payload: %s", payload.c_str());
   
   http.begin(url);
   http.addHeader("Content-Type", "application/json");
 
   int httpCode = http.POST(payload);
   
-  Serial.print("[AUTH] HTTP Response Code: ");
-  Serial.println(httpCode);
+  LOG_D("AUTH", "HTTP Response Code: %d", httpCode);
   
   bool success = false;
 
@@ -34,60 +43,50 @@ bool getToken(const String &device_id, const String &default_token) {
     JsonDocument doc;
     String response = http.getString();
     
-    Serial.print("[AUTH] Response: ");
-    Serial.println(response);
+    LOG_D("AUTH", "Response: %s", response.c_str());
     
     DeserializationError error = deserializeJson(doc, response);
 
     if (error) {
-      Serial.print("[AUTH] JSON Deserialization Failed: ");
-      Serial.println(error.c_str());
+      LOG_E("AUTH", "JSON Deserialization Failed: %s", error.c_str());
     } else {
       if (doc["token"].is<String>()) {
         auth_token = doc["token"].as<String>();
         success = true;
-        Serial.println("[AUTH] Got token from 'token' field");
+        LOG_D("AUTH", "Got token from 'token' field");
       } else if (doc["o_token"].is<String>()) {
         auth_token = doc["o_token"].as<String>();
         success = true;
-        Serial.println("[AUTH] Got token from 'o_token' field");
+        LOG_D("AUTH", "Got token from 'o_token' field");
       } else {
-        Serial.println("[AUTH] No token field found in response");
-        Serial.println("[AUTH] Available keys in response:");
-        for (JsonPair kv : doc.as<JsonObject>()) {
-          Serial.print("  - ");
-          Serial.println(kv.key().c_str());
+        LOG_W("AUTH", "No token field found in response");
+        if (LOG_ENABLED(LOG_LEVEL_DEBUG)) {
+          for (JsonPair kv : doc.as<JsonObject>()) {
+            LOG_D("AUTH", "  key: %s", kv.key().c_str());
+          }
         }
       }
 
       if (success) {
-        Serial.println("[AUTH] Success! Token: " + auth_token);
+        LOG_I("AUTH", "Success! Token: %s...", auth_token.substring(0, 10).c_str());
         if (saveAuthToken(auth_token)) {
-          Serial.println("[AUTH] Token saved to SD card");
+          LOG_D("AUTH", "Token saved to SD card");
         } else {
-          Serial.println("[AUTH] Failed to save token to SD card");
+          LOG_E("AUTH", "Failed to save token to SD card");
         }
       }
     }
   } else {
-    Serial.print("[AUTH] HTTP Error: ");
-    Serial.println(httpCode);
+    LOG_W("AUTH", "HTTP Error: %d", httpCode);
     
     String errorResponse = http.getString();
     if (errorResponse.length() > 0) {
-      Serial.print("[AUTH] Error Response: ");
-      Serial.println(errorResponse);
+      LOG_D("AUTH", "Error Response: %s", errorResponse.c_str());
     }
     
     if (httpCode < 0) {
-      Serial.print("[AUTH] WiFi Status: ");
-      Serial.println(WiFi.status());
-      Serial.print("[AUTH] WiFi Connected: ");
-      Serial.println(WiFi.status() == WL_CONNECTED ? "Yes" : "No");
-      if (WiFi.status() == WL_CONNECTED) {
-        Serial.print("[AUTH] IP Address: ");
-        Serial.println(WiFi.localIP());
-      }
+      LOG_W("AUTH", "WiFi status %d, connected: %s, IP %s", WiFi.status(),
+            WiFi.status() == WL_CONNECTED ? "Yes" : "No", WiFi.localIP().toString().c_str());
     }
   }
 
@@ -96,85 +95,102 @@ bool getToken(const String &device_id, const String &default_token) {
 }
 
 void processReceivedData(JsonDocument &doc) {
-  Serial.println("[DATA] Processing received data...");
+  LOG_D("DATA", "Processing received data...");
   
   if (doc["users"].is<JsonArray>()) {
     JsonArray users = doc["users"].as<JsonArray>();
-    Serial.printf("[DATA] Received %d user records\n", users.size());
+    LOG_I("DATA", "Received %d user records", users.size());
     
     for (JsonObject user : users) {
       if (user["emp_id"].is<String>() && user["name"].is<String>()) {
-        String emp_id = user["emp_id"].as<String>();
-        String name = user["name"].as<String>();
-        Serial.printf("[DATA] User: %s - %s\n", emp_id.c_str(), name.c_str());
+        LOG_V("DATA", "User: %s - %s", user["emp_id"].as<const char *>(), user["name"].as<const char *>());
       }
     }
   }
 
   if (doc["config"].is<JsonObject>()) {
     JsonObject config = doc["config"].as<JsonObject>();
-    Serial.println("[DATA] Received configuration updates");
+    LOG_I("DATA", "Received configuration updates");
     
     if (config["sync_interval"].is<unsigned long>()) {
+      // Seconds; clamped so a bad value can neither hammer nor starve the server
       unsigned long newSyncInterval = config["sync_interval"].as<unsigned long>();
-      Serial.printf("[DATA] New sync interval: %lu\n", newSyncInterval);
+      LOG_I("DATA", "New sync interval: %lu", newSyncInterval);
+      newSyncInterval = constrain(newSyncInterval, MIN_SERVER_SYNC_INTERVAL_S, MAX_SERVER_SYNC_INTERVAL_S);
+      schedulerSetInterval(processPendingAttendances, newSyncInterval * 1000UL);
+    }
+
+    if (config["duplicate_window"].is<unsigned long>()) {
+      // Seconds; 0 turns duplicate-punch suppression off
+      setDuplicateWindow(config["duplicate_window"].as<unsigned long>());
+      LOG_I("DATA", "Duplicate punch window: %lu s", duplicateWindowMs / 1000);
+    }
+
+    if (config["template_codec"].is<String>()) {
+      // "rle" once the server can decode run-length encoded uploads
+      templateUploadEncoded = config["template_codec"].as<String>() == "rle";
+      LOG_I("DATA", "Template upload codec: %s", templateUploadEncoded ? "rle" : "raw");
+    }
+
+    if (config["template_key"].is<String>() || config["template_storage_key"].is<String>()) {
+      // Keys only come from fetchTemplateKeysJob(), over TLS
+      LOG_W("DATA", "Template key in plain-HTTP config ignored");
+    }
+
+    if (config["log_level"].is<uint8_t>()) {
+      logSetLevel(config["log_level"].as<uint8_t>());
+      LOG_I("DATA", "Log level: %u", logLevel);
     }
     
     if (config["device_name"].is<String>()) {
-      String deviceName = config["device_name"].as<String>();
-      Serial.printf("[DATA] New device name: %s\n", deviceName.c_str());
+      LOG_I("DATA", "New device name: %s", config["device_name"].as<const char *>());
     }
   }
 
   if (doc["fingerprints"].is<JsonArray>()) {
     JsonArray fingerprints = doc["fingerprints"].as<JsonArray>();
-    Serial.printf("[DATA] Received %d fingerprint updates\n", fingerprints.size());
+    LOG_I("DATA", "Received %d fingerprint updates", fingerprints.size());
     
     for (JsonObject fp : fingerprints) {
       if (fp["emp_id"].is<String>() && fp["action"].is<String>()) {
-        String emp_id = fp["emp_id"].as<String>();
-        String action = fp["action"].as<String>();
-        Serial.printf("[DATA] Fingerprint %s: %s\n", emp_id.c_str(), action.c_str());
+        LOG_V("DATA", "Fingerprint %s: %s", fp["emp_id"].as<const char *>(), fp["action"].as<const char *>());
       }
     }
   }
 
   if (doc["message"].is<String>()) {
-    String message = doc["message"].as<String>();
-    Serial.printf("[DATA] Server message: %s\n", message.c_str());
+    LOG_I("DATA", "Server message: %s", doc["message"].as<const char *>());
   }
 
   if (doc["firmware"].is<JsonObject>()) {
     JsonObject firmware = doc["firmware"].as<JsonObject>();
     if (firmware["update_available"].is<bool>() && firmware["update_available"].as<bool>()) {
-      Serial.println("[DATA] Firmware update available!");
+      LOG_I("DATA", "Firmware update available!");
     }
   }
 
   if (doc["attendance_data"].is<JsonArray>()) {
     JsonArray attendance = doc["attendance_data"].as<JsonArray>();
-    Serial.printf("[DATA] Received %d attendance records\n", attendance.size());
+    LOG_I("DATA", "Received %d attendance records", attendance.size());
     
     for (JsonObject record : attendance) {
       if (record["emp_id"].is<String>() && record["timestamp"].is<String>()) {
-        String emp_id = record["emp_id"].as<String>();
-        String timestamp = record["timestamp"].as<String>();
-        Serial.printf("[DATA] Attendance: %s at %s\n", emp_id.c_str(), timestamp.c_str());
+        LOG_V("DATA", "Attendance: %s at %s", record["emp_id"].as<const char *>(), record["timestamp"].as<const char *>());
       }
     }
   }
 
-  Serial.println("[DATA] All received fields:");
-  for (JsonPair kv : doc.as<JsonObject>()) {
-    Serial.printf("  - %s: ", kv.key().c_str());
-    if (kv.value().is<JsonArray>()) {
-      Serial.printf("Array (%d items)\n", kv.value().as<JsonArray>().size());
-    } else if (kv.value().is<JsonObject>()) {
-      Serial.println("Object");
-    } else {
-      String value;
-      serializeJson(kv.value(), value);
-      Serial.println(value);
+  if (LOG_ENABLED(LOG_LEVEL_VERBOSE)) {
+    for (JsonPair kv : doc.as<JsonObject>()) {
+      if (kv.value().is<JsonArray>()) {
+        LOG_V("DATA", "  - %s: Array (%d items)", kv.key().c_str(), kv.value().as<JsonArray>().size());
+      } else if (kv.value().is<JsonObject>()) {
+        LOG_V("DATA", "  - %s: Object", kv.key().c_str());
+      } else {
+        String value;
+        serializeJson(kv.value(), value);
+        LOG_V("DATA", "  - %s: %s", kv.key().c_str(), value.c_str());
+      }
     }
   }
 }
@@ -183,9 +199,9 @@ bool getData(const String &device_id, const String &cid, uint8_t retryCount = 2)
   if (auth_token.isEmpty()) {
     auth_token = loadAuthToken();
     if (!auth_token.isEmpty()) {
-      Serial.println("[DATA] Using stored token from SD card");
+      LOG_D("DATA", "Using stored token from SD card");
     } else {
-      Serial.println("[DATA] No stored token found");
+      LOG_W("DATA", "No stored token found");
     }
   }
 
@@ -196,13 +212,9 @@ bool getData(const String &device_id, const String &cid, uint8_t retryCount = 2)
   String url = base_url + "/attendify/api/get_data?api_key=eW7tTAfk1C";
   String payload = "{\"dev_id\":\"" + device_id + "\",\"o_token\":\"" + auth_token + "\",\"cid\":\"" + cid + "\"}";
   
-  Serial.println("[DATA] === Starting getData Request ===");
-  Serial.print("[DATA] URL: ");
-  Serial.println(url);
-  Serial.print("[DATA] Payload: ");
-  Serial.println(payload);
-  Serial.print("[DATA] Token length: ");
-  Serial.println(auth_token.length());
+  LOG_D("DATA", "URL: %s", url.c_str());
+  LOG_D("DATA", "Payload: %s", payload.c_str());
+  LOG_D("DATA", "Token length: %u", auth_token.length());
   
   http.begin(url);
   http.addHeader("Content-Type", "application/json");
@@ -210,164 +222,218 @@ bool getData(const String &device_id, const String &cid, uint8_t retryCount = 2)
 
   int httpCode = http.POST(payload);
   
-  Serial.print("[DATA] HTTP Response Code: ");
-  Serial.println(httpCode);
+  LOG_D("DATA", "HTTP Response Code: %d", httpCode);
   
   if (httpCode == HTTP_CODE_OK) {
     String response = http.getString();
-    Serial.print("[DATA] Response: ");
-    Serial.println(response);
+    LOG_D("DATA", "Response: %s", response.c_str());
     
     DeserializationError error = deserializeJson(doc, response);
     
     if (error) {
-      Serial.print("[DATA] JSON Deserialization Failed: ");
-      Serial.println(error.c_str());
+      LOG_E("DATA", "JSON Deserialization Failed: %s", error.c_str());
     } else {
-      Serial.println("[DATA] Received valid data");
       success = true;
       
-      Serial.println("[DATA] Received JSON structure:");
-      serializeJsonPretty(doc, Serial);
-      Serial.println();
+      if (LOG_ENABLED(LOG_LEVEL_VERBOSE)) {
+        serializeJsonPretty(doc, Serial);
+        Serial.println();
+      }
 
       if (doc["status"].is<String>()) {
         String status = doc["status"].as<String>();
-        Serial.printf("[DATA] Server status: %s\n", status.c_str());
+        LOG_D("DATA", "Server status: %s", status.c_str());
         
         if (status == "success") {
-          Serial.println("[DATA] ✅ Server responded with success");
           processReceivedData(doc);
         } else if (status == "error") {
-          Serial.println("[DATA] ⚠️ Server responded with error");
-          if (doc["message"].is<String>()) {
-            Serial.printf("[DATA] Error message: %s\n", doc["message"].as<String>().c_str());
-          }
+          LOG_W("DATA", "Server responded with error: %s", doc["message"] | "");
         }
       } else {
-        Serial.println("[DATA] No status field, processing data anyway");
+        LOG_D("DATA", "No status field, processing data anyway");
         processReceivedData(doc);
       }
     }
   } 
   else if (httpCode == HTTP_CODE_UNAUTHORIZED) {
-    Serial.println("[DATA] ❌ Token expired or invalid");
+    LOG_W("DATA", "Token expired or invalid");
     String response = http.getString();
     if (response.length() > 0) {
-      Serial.print("[DATA] Error response: ");
-      Serial.println(response);
+      LOG_D("DATA", "Error response: %s", response.c_str());
     }
     
     if (retryCount > 0) {
-      Serial.println("[DATA] 🔄 Getting new token and retrying...");
+      LOG_I("DATA", "Getting new token and retrying...");
       clearAuthToken();
       http.end();
       if (getToken(device_id, default_token)) {
         return getData(device_id, cid, retryCount - 1);
       } else {
-        Serial.println("[DATA] ❌ Failed to get new token");
+        LOG_E("DATA", "Failed to get new token");
       }
     } else {
-      Serial.println("[DATA] ❌ Max retries reached");
+      LOG_E("DATA", "Max retries reached");
     }
   }
   else {
-    Serial.print("[DATA] ❌ HTTP Error: ");
-    Serial.println(httpCode);
+    LOG_W("DATA", "HTTP Error: %d", httpCode);
     
     String errorResponse = http.getString();
     if (errorResponse.length() > 0) {
-      Serial.print("[DATA] Error response: ");
-      Serial.println(errorResponse);
+      LOG_D("DATA", "Error response: %s", errorResponse.c_str());
     }
     
     if (httpCode < 0) {
-      Serial.print("[DATA] WiFi Status: ");
-      Serial.println(WiFi.status());
-      Serial.print("[DATA] WiFi Connected: ");
-      Serial.println(WiFi.status() == WL_CONNECTED ? "Yes" : "No");
-      if (WiFi.status() == WL_CONNECTED) {
-        Serial.print("[DATA] IP Address: ");
-        Serial.println(WiFi.localIP());
-      }
+      LOG_W("DATA", "WiFi status %d, connected: %s, IP %s", WiFi.status(),
+            WiFi.status() == WL_CONNECTED ? "Yes" : "No", WiFi.localIP().toString().c_str());
     }
   }
 
   http.end();
-  Serial.print("[DATA] Request result: ");
-  Serial.println(success ? "SUCCESS" : "FAILED");
-  Serial.println("[DATA] === End getData Request ===\n");
+  LOG_I("DATA", "getData %s", success ? "SUCCESS" : "FAILED");
   return success;
 }
 
 void loadAndValidateToken() {
-  Serial.println("\n" + String(50, '='));
-  Serial.println("=== TOKEN VALIDATION PROCESS START ===");
-  Serial.println(String(50, '='));
-  
-  Serial.println("[TOKEN] Step 1: Loading stored token from SD card...");
+  LOG_I("TOKEN", "Loading stored token from SD card...");
   auth_token = loadAuthToken();
   
   if (!auth_token.isEmpty()) {
-    Serial.print("✅ Token loaded: ");
-    Serial.println(auth_token.substring(0, 10) + "...");
-    Serial.print("📏 Token length: ");
-    Serial.println(auth_token.length());
-    
-    Serial.println("\n[TOKEN] Step 2: Validating stored token...");
-    Serial.println("Sending test request to verify token...");
+    LOG_D("TOKEN", "Token loaded: %s... (%u chars)", auth_token.substring(0, 10).c_str(), auth_token.length());
     
     if (getData(device_id, cid, 0)) {
-      Serial.println("🎉 SUCCESS: Stored token is valid!");
-      Serial.println("✅ Using existing token");
-      Serial.println(String(50, '='));
-      Serial.println("=== TOKEN VALIDATION COMPLETE ===\n");
+      LOG_I("TOKEN", "Stored token is valid");
       return;
     } else {
-      Serial.println("❌ FAILED: Stored token is invalid or expired");
-      Serial.println("🗑️ Clearing invalid token...");
+      LOG_W("TOKEN", "Stored token is invalid or expired - clearing");
       clearAuthToken();
       auth_token = "";
     }
   } else {
-    Serial.println("❌ No stored token found on SD card");
+    LOG_W("TOKEN", "No stored token found on SD card");
   }
 
-  Serial.println("\n[TOKEN] Step 3: Requesting new token from server...");
-  Serial.print("📡 Server: ");
-  Serial.println(base_url);
-  Serial.print("🆔 Device ID: ");
-  Serial.println(device_id);
+  LOG_I("TOKEN", "Requesting new token from %s for %s", base_url.c_str(), device_id.c_str());
   
   if (getToken(device_id, default_token)) {
-    Serial.println("✅ SUCCESS: New token received from server");
-    Serial.print("📏 New token length: ");
-    Serial.println(auth_token.length());
+    LOG_D("TOKEN", "New token length: %u", auth_token.length());
     
-    Serial.println("\n[TOKEN] Step 4: Validating new token...");
     if (getData(device_id, cid, 0)) {
-      Serial.println("🎉 SUCCESS: New token validated and working!");
-      Serial.println("✅ System ready with new token");
+      LOG_I("TOKEN", "New token validated and working");
     } else {
-      Serial.println("❌ CRITICAL: New token validation failed!");
-      Serial.println("🚨 This indicates a server or configuration issue");
+      LOG_E("TOKEN", "New token validation failed - server or configuration issue");
       clearAuthToken();
       auth_token = "";
     }
   } else {
-    Serial.println("❌ CRITICAL: Failed to get new token from server!");
-    Serial.println("🚨 System cannot authenticate with server");
+    LOG_E("TOKEN", "Failed to get new token from server");
   }
+}
 
-  Serial.println(String(50, '='));
-  Serial.println("=== TOKEN VALIDATION PROCESS END ===");
-  Serial.println(String(50, '=') + "\n");
+// Token attempts the server refused; passes spent waiting for WiFi don't count
+static uint8_t tokenServerFailures = 0;
+
+// One-shot job queued at boot so token round trips never delay punching
+JobResult validateTokenJob() {
+  if (!wifiConnected) return JOB_RETRY;
+  loadAndValidateToken();
+  if (!auth_token.isEmpty()) return JOB_DONE;
+  if (tokenServerFailures < 255) tokenServerFailures++;
+  return JOB_RETRY;
+}
+
+// Poll quickly until WiFi is up, then back off from SYNC_RETRY_DELAY while the server refuses
+unsigned long tokenBackoff(uint8_t) {
+  if (!wifiConnected) return WIFI_POLL_INTERVAL;
+  return min(SYNC_RETRY_DELAY << min((int)tokenServerFailures, 5), SYNC_INTERVAL);
+}
+
+// Scheduled every TEMPLATE_KEY_CHECK_INTERVAL, and triggered by the pack
+// when it needs another device's key. Fetches whichever template keys
+// are missing from TEMPLATE_KEY_URL over TLS, verified against
+// TEMPLATE_KEY_CA_CERT; nothing is sent unless both are set. The server
+// answers with this device's own storage key (derived from its master,
+// which never leaves it), the upload key, and, when "owner" names the
+// device that sealed the pack on this card, that device's storage key.
+JobResult fetchTemplateKeysJob() {
+  const char *owner = packForeignOwner();
+  if (templateKeyAvailable(TEMPLATE_KEY_STORAGE) && templateKeyAvailable(TEMPLATE_KEY_UPLOAD) && !owner) {
+    return JOB_DONE;
+  }
+  if (!TEMPLATE_KEY_URL.startsWith("https://") || !TEMPLATE_KEY_CA_CERT[0]) {
+    static bool warned = false;
+    if (!warned) LOG_W("CRYPT", "No TLS key endpoint configured; templates stay plain");
+    warned = true;
+    return JOB_DONE;
+  }
+  if (!wifiConnected) return JOB_RETRY;
+  if (auth_token.isEmpty() && !getToken(device_id, default_token)) return JOB_RETRY;
+
+  WiFiClientSecure client;
+  client.setCACert(TEMPLATE_KEY_CA_CERT);
+  HTTPClient http;
+  http.setTimeout(10000);
+  if (!http.begin(client, TEMPLATE_KEY_URL)) {
+    LOG_E("CRYPT", "Cannot open %s", TEMPLATE_KEY_URL.c_str());
+    return JOB_RETRY;
+  }
+  http.addHeader("Content-Type", "application/json");
+
+  JsonDocument req;
+  req["cid"] = cid;
+  req["dev_id"] = device_id;
+  req["o_token"] = auth_token;
+  if (owner) req["owner"] = owner;
+  String payload;
+  serializeJson(req, payload);
+
+  // Keys are never logged, not even at VERBOSE
+  int httpCode = http.POST(payload);
+  JsonDocument doc;
+  bool ok = httpCode == HTTP_CODE_OK && !deserializeJson(doc, http.getString());
+  http.end();
+  if (!ok) {
+    LOG_W("CRYPT", "Key fetch failed: %d", httpCode);
+    if (httpCode == HTTP_CODE_UNAUTHORIZED) {
+      clearAuthToken();
+      auth_token = "";
+    }
+    return JOB_RETRY;
+  }
+
+  bool changed = false;
+  if (doc["storage_key"].is<String>()) {
+    bool storageChanged = false;
+    if (!setTemplateKey(TEMPLATE_KEY_STORAGE, doc["storage_key"].as<String>(), &storageChanged)) {
+      LOG_W("CRYPT", "Template storage key rejected");
+    } else if (storageChanged) {
+      LOG_I("CRYPT", "Template storage key set");
+      changed = true;
+    }
+  }
+  if (doc["upload_key"].is<String>()) {
+    if (setTemplateKey(TEMPLATE_KEY_UPLOAD, doc["upload_key"].as<String>())) {
+      LOG_D("CRYPT", "Template upload key set");
+    } else {
+      LOG_W("CRYPT", "Template upload key rejected");
+    }
+  }
+  if (owner) {
+    if (doc["owner_key"].is<String>() && setTemplateForeignKey(owner, doc["owner_key"].as<String>())) {
+      LOG_I("CRYPT", "Key for the pack sealed by %s fetched", owner);
+      changed = true;
+    } else {
+      LOG_W("CRYPT", "No usable key for the pack sealed by %s", owner);
+    }
+  }
+  if (changed) packStorageKeyChanged();
+  return JOB_DONE;
 }
 
 bool sendAttendanceRecords(JsonDocument &doc) {
   if (auth_token.isEmpty()) {
     if (!getToken(device_id, default_token)) {
-      Serial.println("Failed to get auth token");
+      LOG_E("SYNC", "Failed to get auth token");
       return false;
     }
     doc["o_token"] = auth_token;
@@ -381,24 +447,20 @@ bool sendAttendanceRecords(JsonDocument &doc) {
 
   String payload;
   serializeJson(doc, payload);
-  Serial.print("Sending payload: ");
-  Serial.println(payload);
+  LOG_D("SYNC", "Sending payload: %s", payload.c_str());
 
   int httpCode = http.POST(payload);
   bool success = false;
 
-  Serial.printf("HTTP Response code: %d\n", httpCode);
+  LOG_D("SYNC", "HTTP Response code: %d", httpCode);
 
   if (httpCode == HTTP_CODE_OK) {
     success = true;
-    Serial.println("All records synced successfully");
-    
     String response = http.getString();
-    Serial.print("Server response: ");
-    Serial.println(response);
+    LOG_D("SYNC", "Server response: %s", response.c_str());
   } 
   else if (httpCode == HTTP_CODE_UNAUTHORIZED) {
-    Serial.println("Token expired - refreshing...");
+    LOG_W("SYNC", "Token expired - refreshing...");
     
     clearAuthToken();
     auth_token = "";
@@ -412,12 +474,11 @@ bool sendAttendanceRecords(JsonDocument &doc) {
   } 
   else {
     String response = http.getString();
-    Serial.printf("Sync failed: %d - %s\n", httpCode, http.errorToString(httpCode).c_str());
-    Serial.print("Server response: ");
-    Serial.println(response);
+    LOG_W("SYNC", "Sync failed: %d - %s", httpCode, http.errorToString(httpCode).c_str());
+    LOG_D("SYNC", "Server response: %s", response.c_str());
     
     if (httpCode == 500) {
-      Serial.println("Server error 500 - Check server logs");
+      LOG_E("SYNC", "Server error 500 - Check server logs");
     }
   }
 
@@ -425,31 +486,45 @@ bool sendAttendanceRecords(JsonDocument &doc) {
   return success;
 }
 
-void processPendingAttendances() {
-  static unsigned long lastSyncAttempt = 0;
-  static unsigned long retryDelay = SYNC_INTERVAL;
-
-  if (millis() - lastSyncAttempt < retryDelay) {
-    return;
+// Scheduled every SYNC_INTERVAL (or the server's sync_interval); backs off from SYNC_RETRY_DELAY on failure
+JobResult processPendingAttendances() {
+  if (WiFi.status() != WL_CONNECTED) {
+    LOG_D("SYNC", "Skipping sync - WiFi disconnected");
+    return JOB_RETRY;
   }
-  lastSyncAttempt = millis();
 
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("Skipping sync - WiFi disconnected");
-    retryDelay = SYNC_RETRY_DELAY;
-    return;
+  // Move the queue aside so punches logged during the upload start a new
+  // file instead of being deleted with the batch. A batch that failed
+  // earlier is retried before the next one is taken.
+  lockPendingFile();
+  if (!SD.exists(PENDING_ATTENDANCE_INFLIGHT_FILE) && SD.exists(PENDING_ATTENDANCE_FILE)) {
+    SD.rename(PENDING_ATTENDANCE_FILE, PENDING_ATTENDANCE_INFLIGHT_FILE);
   }
+  unlockPendingFile();
 
-  String pendingData = readFromSD(PENDING_ATTENDANCE_FILE);
+  String pendingData = readFromSD(PENDING_ATTENDANCE_INFLIGHT_FILE);
   if (pendingData.isEmpty()) {
-    Serial.println("No pending records to sync");
-    retryDelay = SYNC_INTERVAL;
-    return;
+    // A batch left in place would keep every later one from being taken:
+    // an empty one is dropped, an unreadable one set aside
+    if (SD.exists(PENDING_ATTENDANCE_INFLIGHT_FILE)) {
+      File f = SD.open(PENDING_ATTENDANCE_INFLIGHT_FILE, FILE_READ);
+      bool empty = f && f.size() == 0;
+      if (f) f.close();
+      if (empty) {
+        deleteFromSD(PENDING_ATTENDANCE_INFLIGHT_FILE);
+      } else {
+        LOG_E("SYNC", "%s unreadable; set aside as %s", PENDING_ATTENDANCE_INFLIGHT_FILE.c_str(),
+              PENDING_ATTENDANCE_BAD_FILE.c_str());
+        SD.remove(PENDING_ATTENDANCE_BAD_FILE);
+        SD.rename(PENDING_ATTENDANCE_INFLIGHT_FILE, PENDING_ATTENDANCE_BAD_FILE);
+      }
+    }
+    LOG_D("SYNC", "No pending records to sync");
+    return JOB_DONE;
   }
 
-  Serial.println("Starting attendance sync...");
-  Serial.print("Pending data: ");
-  Serial.println(pendingData);
+  LOG_I("SYNC", "Starting attendance sync...");
+  LOG_V("SYNC", "Pending data: %s", pendingData.c_str());
 
   JsonDocument doc;
   doc["dev_id"] = device_id;
@@ -469,51 +544,59 @@ void processPendingAttendances() {
     line.trim();
     
     if (line.length() > 0) {
+      // emp_id,timestamp[,time_quality]
       int commaPos = line.indexOf(',');
       if (commaPos != -1) {
+        int qualityPos = line.indexOf(',', commaPos + 1);
         String emp_id = line.substring(0, commaPos);
-        String timestamp = line.substring(commaPos + 1);
+        String timestamp = qualityPos == -1 ? line.substring(commaPos + 1) : line.substring(commaPos + 1, qualityPos);
         
-        timestamp.replace(" ", "T");
-        timestamp += "Z";
+        // Older entries were queued as "YYYY-MM-DD HH:MM:SS"
+        if (!timestamp.endsWith("Z")) {
+          timestamp.replace(" ", "T");
+          timestamp += "Z";
+        }
 
         JsonObject record = records.add<JsonObject>();
         record["emp_id"] = emp_id;
         record["timestamp"] = timestamp;
+        if (qualityPos != -1) {
+          record["time_quality"] = line.substring(qualityPos + 1);
+        }
         recordsProcessed++;
         
-        Serial.printf("Added record: emp_id=%s, timestamp=%s\n", emp_id.c_str(), timestamp.c_str());
+        LOG_V("SYNC", "Added record: emp_id=%s, timestamp=%s", emp_id.c_str(), timestamp.c_str());
       }
     }
     startPos = endPos + 1;
   }
 
   if (recordsProcessed == 0) {
-    Serial.println("No valid records to sync");
-    return;
+    LOG_W("SYNC", "No valid records to sync");
+    deleteFromSD(PENDING_ATTENDANCE_INFLIGHT_FILE);
+    return JOB_DONE;
   }
 
-  Serial.printf("Attempting to sync %d records\n", recordsProcessed);
-
-  Serial.println("=== Final JSON to send ===");
-  String debugPayload;
-  serializeJsonPretty(doc, debugPayload);
-  Serial.println(debugPayload);
-  Serial.println("==========================");
+  LOG_I("SYNC", "Attempting to sync %d records", recordsProcessed);
+  if (LOG_ENABLED(LOG_LEVEL_VERBOSE)) {
+    serializeJsonPretty(doc, Serial);
+    Serial.println();
+  }
 
   bool success = sendAttendanceRecords(doc);
 
   if (success) {
-    Serial.printf("Successfully synced %d records\n", recordsProcessed);
+    LOG_I("SYNC", "Successfully synced %d records", recordsProcessed);
     
-    if (deleteFromSD(PENDING_ATTENDANCE_FILE)) {
-      Serial.println("Pending file cleared after successful sync");
+    if (deleteFromSD(PENDING_ATTENDANCE_INFLIGHT_FILE)) {
+      LOG_D("SYNC", "Pending file cleared after successful sync");
     }
-    retryDelay = SYNC_INTERVAL;
-  } else {
-    Serial.println("Sync failed - will retry later");
-    retryDelay = SYNC_RETRY_DELAY;
+    return JOB_DONE;
   }
+
+  LOG_W("SYNC", "Sync failed - will retry later");
+  playBuzzer(BUZZ_SYNC_ERROR);
+  return JOB_RETRY;
 }
 
 bool sendSingleFingerprintRecord(const String &emp_id, const String &finger_id) {
@@ -532,27 +615,24 @@ bool sendSingleFingerprintRecord(const String &emp_id, const String &finger_id)
   String payload;
   serializeJson(doc, payload);
   
-  Serial.println("=== Fingerprint JSON Payload ===");
-  serializeJsonPretty(doc, Serial);
-  Serial.println("\n=================================");
+  LOG_D("FPSYNC", "Payload: %s", payload.c_str());
 
   int httpCode = http.POST(payload);
   bool success = false;
 
-  Serial.printf("Fingerprint sync HTTP Response: %d\n", httpCode);
+  LOG_D("FPSYNC", "HTTP Response: %d", httpCode);
 
   if (httpCode == HTTP_CODE_OK) {
     success = true;
-    Serial.println("Fingerprint record synced successfully");
+    LOG_D("FPSYNC", "Fingerprint record synced successfully");
     
     String response = http.getString();
     if (response.length() > 0) {
-      Serial.print("Server response: ");
-      Serial.println(response);
+      LOG_D("FPSYNC", "Server response: %s", response.c_str());
     }
   } 
   else if (httpCode == HTTP_CODE_UNAUTHORIZED) {
-    Serial.println("Token expired during fingerprint sync");
+    LOG_W("FPSYNC", "Token expired during fingerprint sync");
     clearAuthToken();
     auth_token = "";
     
@@ -563,10 +643,9 @@ bool sendSingleFingerprintRecord(const String &emp_id, const String &finger_id)
   } 
   else {
     String response = http.getString();
-    Serial.printf("Fingerprint sync failed: %d - %s\n", httpCode, http.errorToString(httpCode).c_str());
+    LOG_W("FPSYNC", "Fingerprint sync failed: %d - %s", httpCode, http.errorToString(httpCode).c_str());
     if (response.length() > 0) {
-      Serial.print("Server response: ");
-      Serial.println(response);
+      LOG_D("FPSYNC", "Server response: %s", response.c_str());
     }
   }
 
@@ -613,25 +692,18 @@ void removeSentFingerprintRecords(String sentRecords[], int recordCount) {
   }
 }
 
-bool sendNewFingerprintsToServer() {
-  static unsigned long lastFingerprintSync = 0;
-  const unsigned long syncInterval = 2 * 60 * 1000;
-
-  if (millis() - lastFingerprintSync < syncInterval) {
-    return false;
-  }
-  lastFingerprintSync = millis();
-
+// Scheduled every FINGERPRINT_SYNC_INTERVAL
+JobResult sendNewFingerprintsToServer() {
   if (WiFi.status() != WL_CONNECTED) {
-    return false;
+    return JOB_DONE;
   }
 
   String pendingData = readFromSD(PENDING_FINGERPRINTS_FILE);
   if (pendingData.isEmpty()) {
-    return true;
+    return JOB_DONE;
   }
 
-  Serial.println("Starting fingerprint sync...");
+  LOG_I("FPSYNC", "Starting fingerprint sync...");
 
   int recordsProcessed = 0;
   int startPos = 0;
@@ -658,9 +730,9 @@ bool sendNewFingerprintsToServer() {
           recordsProcessed++;
           processedRecords[recordCount] = line;
           recordCount++;
-          Serial.printf("✅ Successfully sent fingerprint for emp_id: %s\n", emp_id.c_str());
+          LOG_D("FPSYNC", "Sent fingerprint for emp_id: %s", emp_id.c_str());
         } else {
-          Serial.printf("❌ Failed to send fingerprint for emp_id: %s\n", emp_id.c_str());
+          LOG_W("FPSYNC", "Failed to send fingerprint for emp_id: %s", emp_id.c_str());
         }
       }
     }
@@ -668,15 +740,15 @@ bool sendNewFingerprintsToServer() {
   }
 
   if (recordsProcessed == 0) {
-    Serial.println("No valid fingerprint records to sync");
-    return true;
+    LOG_W("FPSYNC", "No valid fingerprint records to sync");
+    return JOB_DONE;
   }
 
-  Serial.printf("Successfully synced %d fingerprint records\n", recordsProcessed);
+  LOG_I("FPSYNC", "Successfully synced %d fingerprint records", recordsProcessed);
   
   removeSentFingerprintRecords(processedRecords, recordCount);
   
-  return true;
+  return JOB_DONE;
 }
 // ============================================
 // Add these functions to server_communication.h
@@ -686,24 +758,17 @@ bool sendNewFingerprintsToServer() {
 bool sendFingerprintTemplateToServer(int emp_id, const String &name, 
                                       const String &finger_id, 
                                       const String &templateFile) {
-  Serial.println("\n=== Sending Fingerprint Template ===");
-  Serial.printf("Employee ID: %d\n", emp_id);
-  Serial.printf("Name: %s\n", name.c_str());
-  Serial.printf("Finger ID: %s\n", finger_id.c_str());
-  Serial.printf("Template File: %s\n", templateFile.c_str());
-  
-  // Read template as Base64
-  String templateBase64 = readTemplateAsBase64(templateFile);
+  LOG_I("TPL", "Sending template: emp_id=%d, name=%s, finger_id=%s", emp_id, name.c_str(), finger_id.c_str());
+  LOG_D("TPL", "Template file: %s", templateFile.c_str());
+  
+  // Read template as Base64, sealed to finger_id once the server has sent a key
+  TemplateUploadBody body;
+  String templateBase64 = readTemplateAsBase64(templateFile, &body, templateUploadEncoded, finger_id);
   if (templateBase64.isEmpty()) {
-    Serial.println("❌ Failed to read template data");
+    LOG_E("TPL", "Failed to read template data");
     return false;
   }
   
-  // Get file size for metadata
-  File file = SD.open(templateFile, FILE_READ);
-  size_t templateSize = file.size();
-  file.close();
-  
   // Prepare JSON payload
   JsonDocument doc;
   doc["cid"] = cid;
@@ -712,26 +777,30 @@ bool sendFingerprintTemplateToServer(int emp_id, const String &name,
   doc["name"] = name;
   doc["finger_id"] = finger_id;
   doc["template_data"] = templateBase64;
-  doc["template_size"] = templateSize;
-  doc["template_format"] = "R307_RAW_BINARY";
+  doc["template_size"] = body.size;
+  if (body.encodedSize) {
+    doc["template_format"] = "R307_RLE";
+    doc["encoded_size"] = body.encodedSize;
+  } else {
+    doc["template_format"] = "R307_RAW_BINARY";
+  }
+  if (body.sealed) {
+    // template_data is nonce(12) | ciphertext | tag(16), finger_id as AAD
+    doc["encryption"] = "AES-256-GCM";
+  }
   doc["encoding"] = "base64";
   
   // Add timestamp
-  DateTime now = rtc.now();
-  char timestamp[25];
-  sprintf(timestamp, "%04d-%02d-%02dT%02d:%02d:%02dZ", 
-          now.year(), now.month(), now.day(),
-          now.hour(), now.minute(), now.second());
+  char timestamp[TS_ISO_LEN];
+  formatIsoTimestamp(timestamp, timeNowUnix());
   doc["timestamp"] = timestamp;
   
   // Serialize to string
   String payload;
   serializeJson(doc, payload);
   
-  Serial.println("\n=== Request Details ===");
-  Serial.printf("Template Size: %d bytes\n", templateSize);
-  Serial.printf("Base64 Length: %d chars\n", templateBase64.length());
-  Serial.printf("Total Payload: %d bytes\n", payload.length());
+  LOG_D("TPL", "Template %u bytes, Base64 %u chars, payload %u bytes",
+        body.size, templateBase64.length(), payload.length());
   
   // Send to server
   HTTPClient http;
@@ -741,21 +810,21 @@ bool sendFingerprintTemplateToServer(int emp_id, const String &name,
   http.addHeader("Content-Type", "application/json");
   http.setTimeout(30000);  // 30 second timeout for large data
   
-  Serial.printf("\nSending to: %s\n", url.c_str());
+  LOG_D("TPL", "Sending to: %s", url.c_str());
   
   int httpCode = http.POST(payload);
   bool success = false;
   
-  Serial.printf("HTTP Response Code: %d\n", httpCode);
+  LOG_D("TPL", "HTTP Response Code: %d", httpCode);
   
   if (httpCode == HTTP_CODE_OK) {
     success = true;
     String response = http.getString();
-    Serial.println("✅ Template sent successfully!");
-    Serial.printf("Server Response: %s\n", response.c_str());
+    LOG_I("TPL", "Template sent successfully");
+    LOG_D("TPL", "Server Response: %s", response.c_str());
   } 
   else if (httpCode == HTTP_CODE_UNAUTHORIZED) {
-    Serial.println("❌ Authentication failed - token may be expired");
+    LOG_W("TPL", "Authentication failed - token may be expired");
     
     // Try to refresh token
     clearAuthToken();
@@ -763,46 +832,37 @@ bool sendFingerprintTemplateToServer(int emp_id, const String &name,
     
     if (getToken(device_id, default_token)) {
       http.end();
-      Serial.println("🔄 Retrying with new token...");
+      LOG_I("TPL", "Retrying with new token...");
       return sendFingerprintTemplateToServer(emp_id, name, finger_id, templateFile);
     }
   }
   else {
     String response = http.getString();
-    Serial.printf("❌ Request failed: %d - %s\n", httpCode, 
-                  http.errorToString(httpCode).c_str());
+    LOG_W("TPL", "Request failed: %d - %s", httpCode, http.errorToString(httpCode).c_str());
     if (response.length() > 0) {
-      Serial.printf("Error Response: %s\n", response.c_str());
+      LOG_D("TPL", "Error Response: %s", response.c_str());
     }
   }
   
   http.end();
-  Serial.println("===================================\n");
   
   return success;
 }
 
 // Process pending fingerprint templates and send to server
-bool processPendingFingerprints() {
-  static unsigned long lastSync = 0;
-  const unsigned long syncInterval = 2 * 60 * 1000;  // 2 minutes
-  
-  if (millis() - lastSync < syncInterval) {
-    return false;
-  }
-  lastSync = millis();
-  
+// (job function; schedule every FINGERPRINT_SYNC_INTERVAL)
+JobResult processPendingFingerprints() {
   if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("⚠️ WiFi not connected - skipping fingerprint sync");
-    return false;
+    LOG_D("TPL", "WiFi not connected - skipping fingerprint sync");
+    return JOB_RETRY;
   }
   
   String pendingData = readFromSD(PENDING_FINGERPRINTS_FILE);
   if (pendingData.isEmpty()) {
-    return true;  // No pending data
+    return JOB_DONE;  // No pending data
   }
   
-  Serial.println("\n📤 Starting fingerprint template sync...");
+  LOG_I("TPL", "Starting fingerprint template sync...");
   
   int processed = 0;
   int succeeded = 0;
@@ -832,29 +892,27 @@ bool processPendingFingerprints() {
         String finger_id = line.substring(comma3 + 1, comma4);
         String templateFile = line.substring(comma4 + 1);
         
-        Serial.printf("\n[%d/%d] Processing: emp_id=%d, name=%s\n", 
-                      processed, processed, emp_id, name.c_str());
+        LOG_D("TPL", "[%d] Processing: emp_id=%d, name=%s", processed, emp_id, name.c_str());
         
-        // Verify template file exists
-        if (!SD.exists(templateFile)) {
-          Serial.printf("⚠️ Template file not found: %s (skipping)\n", 
-                       templateFile.c_str());
+        // Verify the template is packed
+        if (!packFind(packRefSlot(templateFile))) {
+          LOG_W("TPL", "Template file not found: %s (skipping)", templateFile.c_str());
           continue;  // Skip this record
         }
         
         // Send to server
         if (sendFingerprintTemplateToServer(emp_id, name, finger_id, templateFile)) {
           succeeded++;
-          Serial.println("✅ Successfully sent to server");
+          LOG_D("TPL", "Successfully sent to server");
           
           // Optional: Delete template file after successful sync
           // SD.remove(templateFile);
         } else {
-          Serial.println("❌ Failed to send - keeping in queue");
+          LOG_W("TPL", "Failed to send - keeping in queue");
           remainingData += line + "\n";
         }
       } else {
-        Serial.println("⚠️ Invalid record format - skipping");
+        LOG_W("TPL", "Invalid record format - skipping");
       }
     }
     
@@ -862,20 +920,20 @@ bool processPendingFingerprints() {
     delay(100);  // Small delay between requests
   }
   
-  Serial.printf("\n📊 Sync Summary: %d processed, %d succeeded, %d failed\n", 
-                processed, succeeded, processed - succeeded);
+  LOG_I("TPL", "Sync Summary: %d processed, %d succeeded, %d failed",
+        processed, succeeded, processed - succeeded);
   
   // Update pending file with failed records
   if (remainingData.isEmpty()) {
     deleteFromSD(PENDING_FINGERPRINTS_FILE);
-    Serial.println("✅ All fingerprints synced - queue cleared");
+    LOG_D("TPL", "All fingerprints synced - queue cleared");
   } else {
     saveToSD(PENDING_FINGERPRINTS_FILE, remainingData);
-    Serial.printf("⚠️ %d records remain in queue\n", 
-                 processed - succeeded);
+    LOG_W("TPL", "%d records remain in queue", processed - succeeded);
+    return JOB_RETRY;
   }
   
-  return (succeeded > 0);
+  return JOB_DONE;
 }
 
 #endif
\ No newline at end of file
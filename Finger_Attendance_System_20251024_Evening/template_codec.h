@@ -0,0 +1,77 @@
+#ifndef TEMPLATE_CODEC_H
+#define TEMPLATE_CODEC_H
+
+#include <Arduino.h>
+
+// Run-length codec for sensor templates. R307 templates are short
+// stretches of varied bytes separated by long runs of 0x00 (and some
+// 0xFF) padding, so a PackBits-style scheme gets most of what a general
+// compressor would, with a stateless decoder cheap enough to run right
+// before DownChar:
+//
+//   0x00-0x7F  token + 1 literal bytes follow
+//   0x80-0xFF  the next byte repeats (token & 0x7F) + 3 times
+//
+// Encoded data is never more than templateEncodedBound(len) bytes.
+
+const size_t TEMPLATE_RUN_MIN = 3;
+const size_t TEMPLATE_RUN_MAX = 0x7F + TEMPLATE_RUN_MIN;
+const size_t TEMPLATE_LITERAL_MAX = 0x80;
+
+size_t templateEncodedBound(size_t len) {
+  return len + len / TEMPLATE_LITERAL_MAX + 1;
+}
+
+static size_t templateFlushLiterals(const uint8_t *in, size_t from, size_t to, uint8_t *out, size_t o) {
+  while (from < to) {
+    size_t n = min(to - from, TEMPLATE_LITERAL_MAX);
+    out[o++] = n - 1;
+    memcpy(out + o, in + from, n);
+    o += n;
+    from += n;
+  }
+  return o;
+}
+
+// Encodes len bytes of in into out; the encoded length
+size_t templateEncode(const uint8_t *in, size_t len, uint8_t *out) {
+  size_t o = 0;
+  size_t literal = 0;  // Start of bytes not yet written
+  size_t i = 0;
+  while (i < len) {
+    size_t run = 1;
+    while (i + run < len && in[i + run] == in[i] && run < TEMPLATE_RUN_MAX) run++;
+    if (run >= TEMPLATE_RUN_MIN) {
+      o = templateFlushLiterals(in, literal, i, out, o);
+      out[o++] = 0x80 | (run - TEMPLATE_RUN_MIN);
+      out[o++] = in[i];
+      literal = i + run;
+    }
+    i += run;
+  }
+  return templateFlushLiterals(in, literal, len, out, o);
+}
+
+// Decodes into out (outMax bytes); the decoded length, or -1 if malformed
+int templateDecode(const uint8_t *in, size_t len, uint8_t *out, size_t outMax) {
+  size_t o = 0;
+  size_t i = 0;
+  while (i < len) {
+    uint8_t token = in[i++];
+    if (token & 0x80) {
+      size_t n = (token & 0x7F) + TEMPLATE_RUN_MIN;
+      if (i >= len || o + n > outMax) return -1;
+      memset(out + o, in[i++], n);
+      o += n;
+    } else {
+      size_t n = token + 1;
+      if (i + n > len || o + n > outMax) return -1;
+      memcpy(out + o, in + i, n);
+      i += n;
+      o += n;
+    }
+  }
+  return o;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,245 @@
+#ifndef TEMPLATE_CRYPTO_H
+#define TEMPLATE_CRYPTO_H
+
+#include <Preferences.h>
+#include "config.h"
+#include "log.h"
+#include "mbedtls/gcm.h"
+
+// AES-256-GCM sealing for templates at rest and on upload. mbedtls runs
+// the block cipher on the ESP32's AES peripheral when the build enables
+// it (the Arduino core does) and on its portable software AES otherwise,
+// so the same calls work on any target mbedtls builds for.
+//
+// Sealed data is nonce | ciphertext | tag, with a random 96-bit nonce
+// per seal. Callers pass associated data that ties the blob to where it
+// belongs (the pack slot, the upload's finger_id), so a blob moved
+// elsewhere fails to open.
+//
+// Keys are provisioned only over TLS (fetchTemplateKeysJob(), against
+// TEMPLATE_KEY_URL and its pinned CA), never in the plain-HTTP config.
+// Each device gets its own storage key, which the server derives from a
+// master it keeps, e.g. HKDF-SHA256(master, cid ":" device_id), so a key
+// pulled from one terminal opens only that terminal's pack. A
+// replacement configured with the same device_id is given the same key
+// and can restore the old card. The upload and storage keys are kept in
+// NVS, not on the card; with NVS encryption on they are also off a
+// dumped flash image.
+//
+// A pack sealed by another device is opened with that device's key,
+// fetched on request into TEMPLATE_KEY_FOREIGN. It is held in RAM only,
+// just long enough for the pack to be re-sealed under this device's key.
+// Until a key arrives the pack stays plain and uploads go unsealed.
+
+const size_t TEMPLATE_NONCE_LEN = 12;
+const size_t TEMPLATE_TAG_LEN = 16;
+const size_t TEMPLATE_SEAL_OVERHEAD = TEMPLATE_NONCE_LEN + TEMPLATE_TAG_LEN;
+const size_t TEMPLATE_KEY_LEN = 32;
+
+enum TemplateKey : uint8_t {
+  TEMPLATE_KEY_STORAGE,
+  TEMPLATE_KEY_UPLOAD,
+  TEMPLATE_KEY_FOREIGN,  // Another device's storage key; RAM only
+  TEMPLATE_KEY_COUNT
+};
+
+const uint8_t TEMPLATE_KEY_STORED = TEMPLATE_KEY_FOREIGN;  // Keys below this live in NVS
+
+static const char *const TEMPLATE_KEY_NAMES[TEMPLATE_KEY_COUNT] = { "storage", "upload", "foreign" };
+
+static uint8_t templateKeys[TEMPLATE_KEY_COUNT][TEMPLATE_KEY_LEN];
+static bool templateKeyLoaded[TEMPLATE_KEY_COUNT];
+static bool templateKeysRead = false;
+static String templateForeignOwner;  // device_id TEMPLATE_KEY_FOREIGN belongs to
+
+// Time spent in the cipher, per key and direction: storage seals are the
+// cost added to export, storage opens to import, upload seals to upload
+struct TemplateCryptoStats {
+  uint32_t operations;
+  uint32_t failures;
+  uint64_t bytes;
+  uint64_t us;
+};
+
+static TemplateCryptoStats templateCryptoStats[TEMPLATE_KEY_COUNT][2];  // [key][0 seal, 1 open]
+
+static void templateRandom(uint8_t *out, size_t len) {
+  for (size_t i = 0; i < len; i += 4) {
+    uint32_t r = esp_random();
+    memcpy(out + i, &r, min((size_t)4, len - i));
+  }
+}
+
+// Reads the provisioned keys from NVS
+static void templateKeysBegin() {
+  if (templateKeysRead) return;
+
+  Preferences prefs;
+  // The fleet-wide keys once delivered in the server config are not kept
+  if (prefs.begin(TEMPLATE_KEY_OLD_NAMESPACE, true)) {
+    prefs.end();
+    if (prefs.begin(TEMPLATE_KEY_OLD_NAMESPACE, false)) {
+      prefs.clear();
+      prefs.end();
+      LOG_I("CRYPT", "Erased fleet-wide template keys");
+    }
+  }
+
+  if (!prefs.begin(TEMPLATE_KEY_NAMESPACE, true)) {
+    // Nothing has been provisioned yet
+    templateKeysRead = true;
+    return;
+  }
+  for (uint8_t k = 0; k < TEMPLATE_KEY_STORED; k++) {
+    templateKeyLoaded[k] = prefs.getBytes(TEMPLATE_KEY_NAMES[k], templateKeys[k], TEMPLATE_KEY_LEN) == TEMPLATE_KEY_LEN;
+  }
+  prefs.end();
+  templateKeysRead = true;
+}
+
+bool templateKeyAvailable(TemplateKey key) {
+  templateKeysBegin();
+  return templateKeyLoaded[key];
+}
+
+static bool templateParseKey(const String &hex, uint8_t key[TEMPLATE_KEY_LEN]) {
+  if (hex.length() != TEMPLATE_KEY_LEN * 2) return false;
+  for (size_t i = 0; i < TEMPLATE_KEY_LEN; i++) {
+    char byteHex[3] = { hex[i * 2], hex[i * 2 + 1], 0 };
+    char *end;
+    key[i] = strtoul(byteHex, &end, 16);
+    if (*end) return false;
+  }
+  return true;
+}
+
+// Stores a provisioned storage or upload key, given as 64 hex digits.
+// *changed (if given) reports whether it differs from the key already
+// held. A storage key is never replaced by a different one, since
+// everything sealed under the old key would stop opening; rotating it
+// means clearing NVS after re-exporting the templates.
+bool setTemplateKey(TemplateKey which, const String &hex, bool *changed = nullptr) {
+  if (changed) *changed = false;
+  uint8_t key[TEMPLATE_KEY_LEN];
+  if (which >= TEMPLATE_KEY_STORED || !templateParseKey(hex, key)) return false;
+
+  templateKeysBegin();
+  if (templateKeyLoaded[which]) {
+    if (memcmp(key, templateKeys[which], TEMPLATE_KEY_LEN) == 0) return true;
+    if (which == TEMPLATE_KEY_STORAGE) {
+      LOG_E("CRYPT", "Different storage key refused; sealed templates would no longer open");
+      return false;
+    }
+  }
+
+  Preferences prefs;
+  if (!prefs.begin(TEMPLATE_KEY_NAMESPACE, false)) return false;
+  bool ok = prefs.putBytes(TEMPLATE_KEY_NAMES[which], key, TEMPLATE_KEY_LEN) == TEMPLATE_KEY_LEN;
+  prefs.end();
+  if (ok) {
+    memcpy(templateKeys[which], key, TEMPLATE_KEY_LEN);
+    templateKeyLoaded[which] = true;
+    if (changed) *changed = true;
+  }
+  return ok;
+}
+
+// Holds another device's storage key in RAM, for opening its pack
+bool setTemplateForeignKey(const String &owner, const String &hex) {
+  if (owner.isEmpty() || !templateParseKey(hex, templateKeys[TEMPLATE_KEY_FOREIGN])) return false;
+  templateForeignOwner = owner;
+  templateKeyLoaded[TEMPLATE_KEY_FOREIGN] = true;
+  return true;
+}
+
+void templateForgetForeignKey() {
+  memset(templateKeys[TEMPLATE_KEY_FOREIGN], 0, TEMPLATE_KEY_LEN);
+  templateKeyLoaded[TEMPLATE_KEY_FOREIGN] = false;
+  templateForeignOwner = "";
+}
+
+// The key that opens data sealed by device `owner`, if held
+bool templateKeyForOwner(const char *owner, TemplateKey *key) {
+  if (device_id == owner) {
+    *key = TEMPLATE_KEY_STORAGE;
+  } else if (templateKeyLoaded[TEMPLATE_KEY_FOREIGN] && templateForeignOwner == owner) {
+    *key = TEMPLATE_KEY_FOREIGN;
+  } else {
+    return false;
+  }
+  return templateKeyAvailable(*key);
+}
+
+static void templateCryptoRecord(TemplateKey key, bool open, int64_t startUs, size_t len, bool ok) {
+  TemplateCryptoStats &s = templateCryptoStats[key][open];
+  s.operations++;
+  if (!ok) s.failures++;
+  s.bytes += len;
+  s.us += esp_timer_get_time() - startUs;
+}
+
+// Seals len bytes into out (len + TEMPLATE_SEAL_OVERHEAD bytes); the
+// sealed length, or 0 on failure
+size_t templateSeal(TemplateKey key, const uint8_t *in, size_t len, uint8_t *out,
+                    const uint8_t *aad, size_t aadLen) {
+  if (!templateKeyAvailable(key)) return 0;
+  int64_t startUs = esp_timer_get_time();
+
+  uint8_t *nonce = out;
+  uint8_t *cipher = out + TEMPLATE_NONCE_LEN;
+  uint8_t *tag = cipher + len;
+  templateRandom(nonce, TEMPLATE_NONCE_LEN);
+
+  mbedtls_gcm_context gcm;
+  mbedtls_gcm_init(&gcm);
+  bool ok = mbedtls_gcm_setkey(&gcm, MBEDTLS_CIPHER_ID_AES, templateKeys[key], TEMPLATE_KEY_LEN * 8) == 0 &&
+            mbedtls_gcm_crypt_and_tag(&gcm, MBEDTLS_GCM_ENCRYPT, len, nonce, TEMPLATE_NONCE_LEN,
+                                      aad, aadLen, in, cipher, TEMPLATE_TAG_LEN, tag) == 0;
+  mbedtls_gcm_free(&gcm);
+
+  templateCryptoRecord(key, false, startUs, len, ok);
+  return ok ? len + TEMPLATE_SEAL_OVERHEAD : 0;
+}
+
+// Opens a sealed blob into out (len - TEMPLATE_SEAL_OVERHEAD bytes); the
+// plaintext length, or -1 if the key is missing or the blob was altered
+int templateOpen(TemplateKey key, const uint8_t *in, size_t len, uint8_t *out,
+                 const uint8_t *aad, size_t aadLen) {
+  if (len < TEMPLATE_SEAL_OVERHEAD) return -1;
+  if (!templateKeyAvailable(key)) {
+    LOG_W("CRYPT", "No %s key provisioned", TEMPLATE_KEY_NAMES[key]);
+    return -1;
+  }
+  int64_t startUs = esp_timer_get_time();
+
+  size_t plainLen = len - TEMPLATE_SEAL_OVERHEAD;
+  const uint8_t *nonce = in;
+  const uint8_t *cipher = in + TEMPLATE_NONCE_LEN;
+  const uint8_t *tag = cipher + plainLen;
+
+  mbedtls_gcm_context gcm;
+  mbedtls_gcm_init(&gcm);
+  bool ok = mbedtls_gcm_setkey(&gcm, MBEDTLS_CIPHER_ID_AES, templateKeys[key], TEMPLATE_KEY_LEN * 8) == 0 &&
+            mbedtls_gcm_auth_decrypt(&gcm, plainLen, nonce, TEMPLATE_NONCE_LEN, aad, aadLen,
+                                     tag, TEMPLATE_TAG_LEN, cipher, out) == 0;
+  mbedtls_gcm_free(&gcm);
+
+  templateCryptoRecord(key, true, startUs, plainLen, ok);
+  if (!ok) LOG_E("CRYPT", "Template failed authentication");
+  return ok ? (int)plainLen : -1;
+}
+
+void printTemplateCryptoStats() {
+  for (uint8_t k = 0; k < TEMPLATE_KEY_COUNT; k++) {
+    for (uint8_t open = 0; open < 2; open++) {
+      const TemplateCryptoStats &s = templateCryptoStats[k][open];
+      if (s.operations == 0) continue;
+      Serial.printf("AES-GCM %s %s: %lu ops, %lu failed, %.1f us/op, %.1f KB/s\n",
+                    TEMPLATE_KEY_NAMES[k], open ? "open" : "seal",
+                    (unsigned long)s.operations, (unsigned long)s.failures,
+                    (double)s.us / s.operations, s.us ? s.bytes * 1e6 / 1024.0 / s.us : 0.0);
+    }
+  }
+}
+
+#endif
\ No newline at end of file
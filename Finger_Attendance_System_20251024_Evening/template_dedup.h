@@ -0,0 +1,102 @@
+#ifndef TEMPLATE_DEDUP_H
+#define TEMPLATE_DEDUP_H
+
+#include "config.h"
+#include "globals.h"
+#include "sd_functions.h"
+#include "employee_groups.h"
+#include "template_functions.h"
+#include "template_pack.h"
+#include "template_export.h"
+#include "log.h"
+
+// Finds fingers enrolled more than once. Two checks:
+//
+//  - Byte-identical copies: packed templates with the same CRC-32 and
+//    size, found from the in-RAM pack index without touching the sensor.
+//  - Biometric duplicates: each occupied slot is loaded and searched
+//    against the slots below it, so every pair is compared once.
+//
+// A duplicate in the same employee group is merged: the higher slot is
+// deleted from the sensor, the group map and the pack. A match between
+// different employees can't be resolved automatically and is only
+// reported. Imports are checked the same way before they are stored (see
+// findEnrolledDuplicate()).
+
+void dedupScanLibrary() {
+  if (exportRunning) {
+    failMessage("Export running");
+    return;
+  }
+
+  uint8_t occupied[(FINGER_SLOT_COUNT + 8) / 8];
+  int total = readOccupiedSlots(occupied);
+  if (total < 0) {
+    failMessage("Sensor not answering");
+    return;
+  }
+
+  Serial.println("\n=== Duplicate Templates ===");
+  uint16_t copies = 0;
+  for (uint16_t slot = 1; slot <= FINGER_SLOT_COUNT; slot++) {
+    const PackEntry *e = packFind(slot);
+    if (!e) continue;
+    uint16_t other = packFindByContent(e->crc, e->size, slot);
+    if (other) {
+      Serial.printf("  Packed slots %u and %u are identical (crc %08lX)\n", slot, other, (unsigned long)e->crc);
+      copies++;
+    }
+  }
+
+  uint16_t checked = 0, merged = 0, conflicts = 0;
+  for (uint16_t slot = 1; slot <= FINGER_SLOT_COUNT; slot++) {
+    if (!slotBit(occupied, slot)) continue;
+    checked++;
+
+    ScreenFrame frame = textScreen();
+    addScreenLine(frame, 0, 0, 1, "Finding duplicates");
+    addScreenLine(frame, 0, 16, 1, "Checked: %u/%d", checked, total);
+    addScreenLine(frame, 0, 32, 1, "Merged: %u", merged);
+    postScreen(frame);
+
+    uint8_t params[3] = { 0x01, (uint8_t)(slot >> 8), (uint8_t)(slot & 0xFF) };
+    if (exchangeCommand(CMD_LOADCHAR, params, 3) != 0x00) continue;
+    uint16_t match = findEnrolledDuplicate(1, 1, slot - 1);
+    if (!match) continue;
+
+    uint16_t empId = employeeForSlot(slot);
+    uint16_t matchEmpId = employeeForSlot(match);
+    if (empId != matchEmpId) {
+      Serial.printf("  Slot %u (%s) matches slot %u (%s); left for review\n",
+                    slot, getNameByID(empId), match, getNameByID(matchEmpId));
+      conflicts++;
+      continue;
+    }
+
+    if (deleteTemplate(slot)) {
+      assignSlot(slot, 0);
+      packRemove(slot);
+      updateFingerprintDB(slot, false);
+      setSlotBit(occupied, slot, false);
+      Serial.printf("  Slot %u duplicates slot %u (%s); merged\n", slot, match, getNameByID(empId));
+      merged++;
+    }
+  }
+
+  Serial.printf("Checked %u slots: %u merged, %u conflicts, %u identical packed copies\n",
+                checked, merged, conflicts, copies);
+  Serial.println("===========================\n");
+  LOG_I("DEDUP", "%u merged, %u conflicts, %u identical packed copies", merged, conflicts, copies);
+
+  ScreenFrame frame = textScreen();
+  addScreenLine(frame, 0, 0, 1, "Duplicates");
+  addScreenLine(frame, 0, 16, 1, "Merged: %u", merged);
+  addScreenLine(frame, 0, 24, 1, "Conflicts: %u", conflicts);
+  addScreenLine(frame, 0, 32, 1, "Free slots: %d", FINGER_SLOT_COUNT - total + merged);
+  postScreen(frame);
+  if (conflicts) buzzerFail();
+  else buzzerSuccess();
+  delay(3000);
+}
+
+#endif
\ No newline at end of file
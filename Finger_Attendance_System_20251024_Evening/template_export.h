@@ -0,0 +1,383 @@
+#ifndef TEMPLATE_EXPORT_H
+#define TEMPLATE_EXPORT_H
+
+#include "config.h"
+#include "globals.h"
+#include "scheduler.h"
+#include "sd_functions.h"
+#include "template_functions.h"
+#include "template_pack.h"
+#include "log.h"
+
+// Bulk backup and restore between the sensor library and the template
+// pack.
+//
+// Export: occupied
+// slots are read from the sensor's index table in one exchange per 256
+// slots instead of a LoadChar probe per slot, then a scheduler job
+// exports one template per pass, so punches are still served while it
+// runs.
+//
+// Each finished slot is appended to EXPORT_JOURNAL_FILE. The journal
+// exists only while an export is in progress, so one found at boot means
+// a reset cut the run short: the job re-reads the index table, drops the
+// journalled slots and carries on. A run that reaches the end removes
+// the journal, failures or not, and lists any slots it could not export
+// in EXPORT_FAILED_FILE; a new export from the menu always starts over.
+// Templates identical to their packed copy aren't rewritten.
+//
+// Restore: every packed template is imported in one blocking pass (see
+// bulkRestoreTemplates()).
+
+static uint8_t exportPending[(FINGER_SLOT_COUNT + 8) / 8];  // Bit per slot still to do
+static uint8_t exportFailedSlots[(FINGER_SLOT_COUNT + 8) / 8];
+static uint16_t exportNext = 1;
+static uint16_t exportTotal = 0;
+static uint16_t exportWritten = 0;
+static uint16_t exportUnchanged = 0;
+static uint16_t exportFailed = 0;
+static bool exportRunning = false;
+
+JobResult bulkExportStep();
+
+static bool slotBit(const uint8_t *bits, uint16_t slot) {
+  return bits[slot / 8] & (1 << (slot % 8));
+}
+
+static void setSlotBit(uint8_t *bits, uint16_t slot, bool on) {
+  if (on) bits[slot / 8] |= 1 << (slot % 8);
+  else bits[slot / 8] &= ~(1 << (slot % 8));
+}
+
+static bool exportIsPending(uint16_t slot) {
+  return slotBit(exportPending, slot);
+}
+
+static void exportClearPending(uint16_t slot) {
+  setSlotBit(exportPending, slot, false);
+}
+
+// Fills a slot bitmap from the sensor's index table; the number of
+// occupied slots, or -1
+static int readOccupiedSlots(uint8_t *bits) {
+  memset(bits, 0, (FINGER_SLOT_COUNT + 8) / 8);
+  int count = 0;
+  for (uint8_t page = 0; page * 256 <= FINGER_SLOT_COUNT; page++) {
+    uint8_t bitmap[32];
+    if (!readIndexTable(page, bitmap)) return -1;
+    for (int bit = 0; bit < 256; bit++) {
+      int slot = page * 256 + bit;
+      if (slot < 1 || slot > FINGER_SLOT_COUNT || !(bitmap[bit / 8] & (1 << (bit % 8)))) continue;
+      setSlotBit(bits, slot, true);
+      count++;
+    }
+  }
+  return count;
+}
+
+// Clears the slots an interrupted export already finished
+static int exportApplyJournal() {
+  String journal = readFromSD(EXPORT_JOURNAL_FILE);
+  int done = 0;
+  int startPos = 0;
+  while (startPos < journal.length()) {
+    int endPos = journal.indexOf('\n', startPos);
+    if (endPos == -1) endPos = journal.length();
+    int slot = journal.substring(startPos, endPos).toInt();
+    if (slot >= 1 && slot <= FINGER_SLOT_COUNT && exportIsPending(slot)) {
+      exportClearPending(slot);
+      done++;
+    }
+    startPos = endPos + 1;
+  }
+  return done;
+}
+
+// Replaces EXPORT_FAILED_FILE with this run's failed slots, one per line
+static void exportWriteFailed() {
+  SD.remove(EXPORT_FAILED_FILE);
+  if (exportFailed == 0) return;
+  String list;
+  for (uint16_t slot = 1; slot <= FINGER_SLOT_COUNT; slot++) {
+    if (slotBit(exportFailedSlots, slot)) list += String(slot) + "\n";
+  }
+  saveToSD(EXPORT_FAILED_FILE, list);
+}
+
+static void exportFinish() {
+  exportRunning = false;
+  schedulerCancel(bulkExportStep);
+  SD.remove(EXPORT_JOURNAL_FILE);
+  exportWriteFailed();
+  LOG_I("EXPORT", "Done: %u written, %u unchanged, %u failed of %u",
+        exportWritten, exportUnchanged, exportFailed, exportTotal);
+  if (exportFailed) LOG_W("EXPORT", "Failed slots listed in %s", EXPORT_FAILED_FILE.c_str());
+}
+
+// Scheduled every BULK_EXPORT_STEP_MS while an export runs
+JobResult bulkExportStep() {
+  while (exportNext <= FINGER_SLOT_COUNT && !exportIsPending(exportNext)) exportNext++;
+  if (exportNext > FINGER_SLOT_COUNT) {
+    exportFinish();
+    return JOB_DONE;
+  }
+
+  uint16_t slot = exportNext++;
+  exportClearPending(slot);
+
+  bool unchanged = false;
+  if (exportRealFingerprintTemplate(slot, &unchanged)) {
+    if (unchanged) exportUnchanged++;
+    else exportWritten++;
+    char line[8];
+    int len = snprintf(line, sizeof(line), "%u\n", slot);
+    appendToSD(EXPORT_JOURNAL_FILE.c_str(), line, len);
+  } else {
+    // Left out of the journal, so a resume after a reset tries it again
+    exportFailed++;
+    setSlotBit(exportFailedSlots, slot, true);
+    LOG_W("EXPORT", "Slot %u failed", slot);
+  }
+  return JOB_DONE;
+}
+
+// Starts a bulk export, or with resume carries on from the journal an
+// interrupted one left; the number of templates to export, or -1 if one
+// is running or the sensor didn't answer
+int bulkExportStart(bool resume = false) {
+  if (exportRunning) return -1;
+
+  int occupied = readOccupiedSlots(exportPending);
+  if (occupied < 0) return -1;
+
+  int done = 0;
+  if (resume && SD.exists(EXPORT_JOURNAL_FILE)) {
+    done = exportApplyJournal();
+  } else {
+    saveToSD(EXPORT_JOURNAL_FILE, "");
+  }
+  memset(exportFailedSlots, 0, sizeof(exportFailedSlots));
+
+  exportNext = 1;
+  exportTotal = occupied;
+  exportWritten = exportUnchanged = exportFailed = 0;
+  exportRunning = true;
+  schedulerAddPeriodic("tpl_export", bulkExportStep, BULK_EXPORT_STEP_MS);
+
+  if (done) LOG_I("EXPORT", "Resuming: %d of %d templates already exported", done, occupied);
+  else LOG_I("EXPORT", "Exporting %d templates", occupied);
+  return occupied - done;
+}
+
+// Called from setup(); picks up an export a reset interrupted
+void bulkExportResume() {
+  if (SD.exists(EXPORT_JOURNAL_FILE)) bulkExportStart(true);
+}
+
+void exportAllTemplates() {
+  ScreenFrame frame = textScreen();
+  addScreenLine(frame, 0, 0, 1, "Exporting Templates...");
+  addScreenLine(frame, 0, 8, 1, "Format: Raw Binary");
+  postScreen(frame);
+
+  int remaining = bulkExportStart();
+
+  frame = textScreen();
+  if (remaining < 0) {
+    addScreenLine(frame, 0, 0, 1, exportRunning ? "Export running" : "Sensor not answering");
+  } else if (remaining == 0 && exportTotal == 0) {
+    addScreenLine(frame, 0, 0, 1, "No templates found");
+  } else {
+    addScreenLine(frame, 0, 0, 1, "Export started");
+    addScreenLine(frame, 0, 16, 1, "Templates: %d", remaining);
+    addScreenLine(frame, 0, 32, 1, "Runs in background");
+    addScreenLine(frame, 0, 40, 1, "to %s", TEMPLATE_PACK_FILE.c_str());
+    buzzerSuccess();
+  }
+  postScreen(frame);
+  delay(2000);
+}
+
+// ---------------- Bulk Restore ----------------
+static uint16_t nextPackedSlot(uint16_t after) {
+  for (uint16_t slot = after + 1; slot <= FINGER_SLOT_COUNT; slot++) {
+    if (packFind(slot)) return slot;
+  }
+  return 0;
+}
+
+static uint16_t lowestFreeSlot(const uint8_t *occupied) {
+  for (uint16_t slot = 1; slot <= FINGER_SLOT_COUNT; slot++) {
+    if (!slotBit(occupied, slot)) return slot;
+  }
+  return 0;
+}
+
+// True if sensor slot holds exactly this template (uses CharBuffer1)
+static bool sensorSlotHolds(uint16_t slot, const uint8_t *data, size_t size, uint8_t *scratch) {
+  uint8_t params[3] = { 0x01, (uint8_t)(slot >> 8), (uint8_t)(slot & 0xFF) };
+  size_t got = 0;
+  return exchangeCommand(CMD_LOADCHAR, params, 3) == 0x00 &&
+         uploadTemplateFromModule(scratch, TEMPLATE_MAX_BYTES, &got) &&
+         got == size && memcmp(scratch, data, size) == 0;
+}
+
+// Imports every packed template in one pass: into its original slot when
+// that is free, skipped when the slot already holds the same template,
+// otherwise into the lowest free slot (and its employee group follows
+// it). A template the sensor already matches in any slot is not stored
+// again. Occupancy comes from one index-table read instead of probing
+// each slot, and the next template is read from SD while the sensor is
+// storing the current one.
+void bulkRestoreTemplates() {
+  if (exportRunning) {
+    failMessage("Export running");
+    return;
+  }
+
+  uint8_t occupied[(FINGER_SLOT_COUNT + 8) / 8];
+  if (readOccupiedSlots(occupied) < 0) {
+    failMessage("Sensor not answering");
+    return;
+  }
+
+  uint8_t *cur = (uint8_t *)malloc(TEMPLATE_MAX_BYTES);
+  uint8_t *next = (uint8_t *)malloc(TEMPLATE_MAX_BYTES);
+  uint8_t *scratch = (uint8_t *)malloc(TEMPLATE_MAX_BYTES);
+  if (!cur || !next || !scratch) {
+    free(cur);
+    free(next);
+    free(scratch);
+    failMessage("Out of memory");
+    return;
+  }
+
+  int total = 0;
+  for (uint16_t s = nextPackedSlot(0); s; s = nextPackedSlot(s)) total++;
+
+  uint16_t restored = 0, moved = 0, present = 0, duplicates = 0, failed = 0;
+  uint32_t startMs = millis();
+  uint16_t slot = nextPackedSlot(0);
+  int size = slot ? packRead(slot, cur, TEMPLATE_MAX_BYTES) : -1;
+
+  while (slot) {
+    uint16_t following = nextPackedSlot(slot);
+    uint16_t empId = packFind(slot)->empId;
+    uint16_t target = 0;
+
+    if (size < 0 || !validateTemplate(cur, size)) {
+      failed++;
+    } else if (!slotBit(occupied, slot)) {
+      target = slot;
+    } else if (sensorSlotHolds(slot, cur, size, scratch)) {
+      present++;
+    } else if (!(target = lowestFreeSlot(occupied))) {
+      LOG_W("RESTORE", "Sensor full; slot %u not restored", slot);
+      failed++;
+    }
+
+    int nextSize = -1;
+    bool downloaded = target && downloadTemplateToModuleWithVerify(1, cur, size);
+    uint16_t duplicate = downloaded ? findEnrolledDuplicate(1) : 0;
+    if (duplicate) {
+      duplicates++;
+      if (employeeForSlot(duplicate) == empId) {
+        LOG_I("RESTORE", "Slot %u already enrolled as slot %u", slot, duplicate);
+      } else {
+        LOG_W("RESTORE", "Slot %u (emp %u) matches slot %u (emp %u); not restored",
+              slot, empId, duplicate, employeeForSlot(duplicate));
+      }
+      if (following) nextSize = packRead(following, next, TEMPLATE_MAX_BYTES);
+    } else if (downloaded) {
+      uint8_t params[3] = { 0x01, (uint8_t)(target >> 8), (uint8_t)(target & 0xFF) };
+      flushSerialInput(mySerial, 10);
+      sendCommandPacket(mySerial, CMD_STORE, params, 3);
+      int64_t sentUs = esp_timer_get_time();
+      if (following) nextSize = packRead(following, next, TEMPLATE_MAX_BYTES);
+
+      // A reply that came in during the SD read would be timed with the
+      // read's latency added, so only a reply still to come is sampled
+      bool sample = mySerial.available() == 0;
+      if (readCommandAck(CMD_STORE, sentUs, sample) == 0x00) {
+        setSlotBit(occupied, target, true);
+        if (employeeForSlot(target) != empId) assignSlot(target, empId);
+        restored++;
+        if (target != slot) {
+          moved++;
+          LOG_I("RESTORE", "Slot %u occupied; restored into %u", slot, target);
+        }
+      } else {
+        failed++;
+      }
+    } else {
+      if (target) failed++;
+      if (following) nextSize = packRead(following, next, TEMPLATE_MAX_BYTES);
+    }
+
+    ScreenFrame frame = textScreen();
+    addScreenLine(frame, 0, 0, 1, "Restoring...");
+    addScreenLine(frame, 0, 16, 1, "Done: %d/%d", restored + present + duplicates + failed, total);
+    addScreenLine(frame, 0, 32, 1, "Failed: %u", failed);
+    postScreen(frame);
+
+    uint8_t *t = cur;
+    cur = next;
+    next = t;
+    size = nextSize;
+    slot = following;
+  }
+
+  free(cur);
+  free(next);
+  free(scratch);
+
+  uint32_t elapsedMs = millis() - startMs;
+  float rate = elapsedMs ? restored * 1000.0f / elapsedMs : 0;
+  LOG_I("RESTORE", "%u restored (%u to new slots), %u already present, %u duplicates, %u failed in %.1f s (%.2f templates/s)",
+        restored, moved, present, duplicates, failed, elapsedMs / 1000.0f, rate);
+
+  String logEntry = "RESTORE: RESTORED=" + String(restored) +
+                    ", PRESENT=" + String(present + duplicates) +
+                    ", FAILED=" + String(failed) +
+                    ", TIME=" + String(timeNowUnix()) +
+                    ", DEVICE=" + device_id + "\n";
+  appendTemplateToSD("/templates/import_log.txt", logEntry);
+
+  ScreenFrame frame = textScreen();
+  addScreenLine(frame, 0, 0, 1, "Restore Complete");
+  addScreenLine(frame, 0, 16, 1, "Restored: %u", restored);
+  addScreenLine(frame, 0, 24, 1, "Present: %u", present + duplicates);
+  addScreenLine(frame, 0, 32, 1, "Failed: %u", failed);
+  addScreenLine(frame, 0, 48, 1, "%.1f templates/s", rate);
+  postScreen(frame);
+  if (failed) buzzerFail();
+  else buzzerSuccess();
+  delay(3000);
+}
+
+void importTemplateFromFile() {
+  ScreenFrame frame = textScreen();
+  addScreenLine(frame, 0, 0, 1, "Template Restore");
+  addScreenLine(frame, 0, 16, 1, "All packed templates");
+  addScreenLine(frame, 0, 40, 1, "Press to continue");
+  postScreen(frame);
+
+  unsigned long startTime = millis();
+  while (millis() - startTime < 10000) {
+    if (digitalRead(BUTTON_PIN) == LOW) {
+      delay(50);
+      if (digitalRead(BUTTON_PIN) == LOW) {
+        bulkRestoreTemplates();
+        return;
+      }
+    }
+    delay(100);
+  }
+  
+  frame = textScreen();
+  addScreenLine(frame, 0, 0, 1, "Import cancelled");
+  postScreen(frame);
+  delay(2000);
+}
+
+#endif
\ No newline at end of file
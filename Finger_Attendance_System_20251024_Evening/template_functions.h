@@ -4,6 +4,10 @@
 #include "config.h"
 #include "globals.h"
 #include "utility_functions.h"
+#include "time_service.h"
+#include "log.h"
+#include "employee_groups.h"
+#include "template_pack.h"
 
 const uint32_t MODULE_ADDRESS = 0xFFFFFFFFUL;
 
@@ -28,9 +32,10 @@ const uint8_t MAX_RETRY = 3;
 #define CMD_EMPTY 0x0D
 #define CMD_LOADCHAR 0x07
 #define CMD_TEMPLATECOUNT 0x1D
+#define CMD_READINDEX 0x1F
 
 // Forward declaration for external function
-extern String getNameByID(int id);
+extern const char *getNameByID(int id);
 
 // ---------------- Protocol Helper Functions ----------------
 static void writeUint32BigEndian(Stream &s, uint32_t v) {
@@ -67,20 +72,171 @@ static void flushSerialInput(Stream &s, uint32_t timeoutMs = 50) {
   }
 }
 
+// readPacket()/readAck() failures; all negative so callers can keep testing < 0
+const int PACKET_TIMEOUT = -1;
+const int PACKET_CHECKSUM = -2;
+const int PACKET_UNEXPECTED = -3;  // Well-formed, but not the acknowledgement expected
+
+struct PacketStats {
+  uint32_t packets;
+  uint32_t timeouts;
+  uint32_t checksumErrors;
+  uint32_t framingErrors;   // Bad address or length after a 0xEF01 start code
+  uint32_t skippedBytes;    // Discarded while hunting for a start code
+  uint32_t downloadsVerified;
+  uint32_t downloadMismatches;  // Read back differently from what was sent
+};
+
+static PacketStats packetStats;
+
+// Reads one packet. Bytes before the next 0xEF 0x01 start code are skipped,
+// and a header with the wrong address or an impossible length is dropped
+// and the hunt resumes, so line noise costs a few bytes instead of a
+// timeout. The checksum (PID + length + content) is verified.
 static int readPacket(Stream &s, uint8_t *contentBuf, size_t maxContent, size_t *contentLen, uint32_t timeoutMs = SERIAL_READ_TIMEOUT_MS) {
-  uint8_t hdr[9];
-  if (readBytesWithTimeout(s, hdr, 9, timeoutMs) != 9) return -1;
-  if (hdr[0] != 0xEF || hdr[1] != 0x01) return -1;
-  uint8_t pid = hdr[6];
-  uint16_t lenField = ((uint16_t)hdr[7] << 8) | hdr[8];
-  if (lenField < 2) return -1;
+  uint32_t start = millis();
+  uint8_t hdr[7];  // Address, PID, length
+
+  for (;;) {
+    // Hunt for the start code
+    uint8_t prev = 0;
+    uint8_t b;
+    uint32_t hunted = 0;
+    for (;;) {
+      uint32_t elapsed = millis() - start;
+      if (elapsed >= timeoutMs || readBytesWithTimeout(s, &b, 1, timeoutMs - elapsed) != 1) {
+        packetStats.timeouts++;
+        return PACKET_TIMEOUT;
+      }
+      hunted++;
+      if (prev == 0xEF && b == 0x01) break;
+      prev = b;
+    }
+    packetStats.skippedBytes += hunted - 2;
+
+    if (readBytesWithTimeout(s, hdr, sizeof(hdr), timeoutMs) != sizeof(hdr)) {
+      packetStats.timeouts++;
+      return PACKET_TIMEOUT;
+    }
+    uint32_t address = ((uint32_t)hdr[0] << 24) | ((uint32_t)hdr[1] << 16) | ((uint32_t)hdr[2] << 8) | hdr[3];
+    uint16_t lenField = ((uint16_t)hdr[5] << 8) | hdr[6];
+    if (address == MODULE_ADDRESS && lenField >= 2 && lenField - 2 <= maxContent) break;
+
+    packetStats.framingErrors++;
+    LOG_D("R307", "Framing error (addr 0x%08lX, len %u); resyncing", (unsigned long)address, lenField);
+  }
+
+  uint8_t pid = hdr[4];
+  uint16_t lenField = ((uint16_t)hdr[5] << 8) | hdr[6];
   uint16_t cLen = lenField - 2;
-  if (cLen > maxContent) return -1;
-  if (readBytesWithTimeout(s, contentBuf, cLen + 2, timeoutMs) != (int)(cLen + 2)) return -1;
+  uint8_t chk[2];
+  if (readBytesWithTimeout(s, contentBuf, cLen, timeoutMs) != (int)cLen ||
+      readBytesWithTimeout(s, chk, 2, timeoutMs) != 2) {
+    packetStats.timeouts++;
+    return PACKET_TIMEOUT;
+  }
+
+  uint16_t sum = pid + hdr[5] + hdr[6];
+  for (uint16_t i = 0; i < cLen; i++) sum += contentBuf[i];
+  uint16_t expected = ((uint16_t)chk[0] << 8) | chk[1];
+  if (sum != expected) {
+    packetStats.checksumErrors++;
+    LOG_D("R307", "Checksum mismatch: got 0x%04X, computed 0x%04X", expected, sum);
+    return PACKET_CHECKSUM;
+  }
+
+  packetStats.packets++;
   *contentLen = cLen;
   return pid;
 }
 
+// ---------------- Command Round-Trip Times ----------------
+// Each command keeps a smoothed round-trip time and mean deviation (the
+// TCP retransmit estimator), and its reply deadline is SRTT + 4 x RTTVAR
+// rather than the fixed SERIAL_READ_TIMEOUT_MS, which stays as the
+// ceiling and is used until SENSOR_RTT_MIN_SAMPLES replies have been
+// timed. A missed deadline doubles the next one (up to the ceiling) so a
+// sensor that has genuinely slowed down is relearned. Replies to re-sent
+// commands aren't sampled, since it's unknown which send they answer.
+//
+// All sensor traffic runs on the loop task, so the table needs no lock.
+
+const uint16_t RTT_DATA_PACKET = 0x100;  // Gap between UpChar data packets
+
+struct CommandRtt {
+  uint16_t key;        // Instruction code, or RTT_DATA_PACKET; 0 = unused
+  uint32_t samples;
+  uint32_t srttUs;
+  uint32_t rttvarUs;
+  uint32_t maxUs;
+  uint32_t overdue;    // Replies given up on
+  uint8_t backoff;
+};
+
+static CommandRtt commandRtt[SENSOR_RTT_SLOTS];
+
+static CommandRtt &rttFor(uint16_t key) {
+  for (uint8_t i = 0; i < SENSOR_RTT_SLOTS; i++) {
+    if (commandRtt[i].key == key) return commandRtt[i];
+    if (commandRtt[i].key == 0) {
+      commandRtt[i].key = key;
+      return commandRtt[i];
+    }
+  }
+  return commandRtt[SENSOR_RTT_SLOTS - 1];  // Table full; share the last slot
+}
+
+uint32_t commandTimeoutMs(uint16_t key, uint32_t ceilingMs) {
+  const CommandRtt &r = rttFor(key);
+  if (r.samples < SENSOR_RTT_MIN_SAMPLES) return ceilingMs;
+  uint32_t ms = (r.srttUs + 4 * r.rttvarUs) / 1000 + 1;
+  if (ms < SENSOR_MIN_TIMEOUT_MS) ms = SENSOR_MIN_TIMEOUT_MS;
+  ms <<= r.backoff;
+  return ms < ceilingMs ? ms : ceilingMs;
+}
+
+static void rttSample(uint16_t key, uint32_t us) {
+  CommandRtt &r = rttFor(key);
+  if (r.samples == 0) {
+    r.srttUs = us;
+    r.rttvarUs = us / 2;
+  } else {
+    uint32_t err = us > r.srttUs ? us - r.srttUs : r.srttUs - us;
+    r.rttvarUs = (3 * r.rttvarUs + err) / 4;
+    r.srttUs = (7 * r.srttUs + us) / 8;
+  }
+  if (us > r.maxUs) r.maxUs = us;
+  r.samples++;
+  r.backoff = 0;
+}
+
+static void rttOverdue(uint16_t key) {
+  CommandRtt &r = rttFor(key);
+  r.overdue++;
+  if (r.backoff < SENSOR_RTT_MAX_BACKOFF) r.backoff++;
+}
+
+void printPacketStats() {
+  Serial.println("\n=== Sensor Link ===");
+  Serial.printf("packets %lu, timeouts %lu, checksum errors %lu, framing errors %lu, skipped bytes %lu\n",
+                (unsigned long)packetStats.packets, (unsigned long)packetStats.timeouts,
+                (unsigned long)packetStats.checksumErrors, (unsigned long)packetStats.framingErrors,
+                (unsigned long)packetStats.skippedBytes);
+  Serial.printf("downloads verified %lu, mismatched %lu\n",
+                (unsigned long)packetStats.downloadsVerified, (unsigned long)packetStats.downloadMismatches);
+  Serial.println("cmd    samples  srtt-ms  rttvar-ms  max-ms  timeout-ms  overdue");
+  for (uint8_t i = 0; i < SENSOR_RTT_SLOTS && commandRtt[i].key; i++) {
+    const CommandRtt &r = commandRtt[i];
+    char name[6];
+    if (r.key == RTT_DATA_PACKET) strcpy(name, "data");
+    else snprintf(name, sizeof(name), "0x%02X", r.key);
+    Serial.printf("%-6s %7lu %8.1f %10.1f %7.1f %11lu %8lu\n", name, (unsigned long)r.samples,
+                  r.srttUs / 1000.0, r.rttvarUs / 1000.0, r.maxUs / 1000.0,
+                  (unsigned long)commandTimeoutMs(r.key, SERIAL_READ_TIMEOUT_MS), (unsigned long)r.overdue);
+  }
+  Serial.println("===================\n");
+}
+
 static void sendCommandPacket(Stream &s, uint8_t instruction, const uint8_t *params = nullptr, uint16_t paramsLen = 0) {
   uint16_t packetContentLen = 1 + paramsLen;
   uint16_t lengthField = packetContentLen + 2;
@@ -105,27 +261,31 @@ static int readAck(Stream &s, uint8_t *contentBuf = nullptr, size_t maxContent =
   size_t cLen = 0;
   int pid = readPacket(s, localBuf, sizeof(localBuf), &cLen, timeoutMs);
 
+  if (pid == PACKET_CHECKSUM) {
+    LOG_D("R307", "readAck: Corrupt packet");
+    return pid;
+  }
   if (pid < 0) {
-    Serial.printf("readAck: Timeout after %lu ms (no packet)\n", timeoutMs);
-    return -1;
+    LOG_D("R307", "readAck: Timeout after %lu ms (no packet)", timeoutMs);
+    return pid;
   }
 
   if (pid != PID_ACK) {
-    Serial.printf("readAck: Expected PID_ACK(0x%02X), got 0x%02X\n", PID_ACK, pid);
-    return -1;
+    LOG_D("R307", "readAck: Expected PID_ACK(0x%02X), got 0x%02X", PID_ACK, pid);
+    return PACKET_UNEXPECTED;
   }
 
   if (cLen < 1) {
-    Serial.println("readAck: Packet too short");
-    return -1;
+    LOG_D("R307", "readAck: Packet too short");
+    return PACKET_UNEXPECTED;
   }
 
   uint8_t conf = localBuf[0];
 
   if (conf == 0x00) {
-    Serial.println("readAck: Success (0x00)");
+    LOG_V("R307", "readAck: Success (0x00)");
   } else {
-    Serial.printf("readAck: Confirmation code 0x%02X\n", conf);
+    LOG_D("R307", "readAck: Confirmation code 0x%02X", conf);
   }
 
   if (contentBuf && outContentLen) {
@@ -137,55 +297,104 @@ static int readAck(Stream &s, uint8_t *contentBuf = nullptr, size_t maxContent =
   return (int)conf;
 }
 
+// readAck() against the command's learned deadline; the round trip is
+// sampled when sentUs is the first send of the command
+static int readCommandAck(uint16_t key, int64_t sentUs, bool sample, uint8_t *contentBuf = nullptr, size_t maxContent = 0,
+                          size_t *outContentLen = nullptr, uint32_t ceilingMs = SERIAL_READ_TIMEOUT_MS) {
+  int conf = readAck(mySerial, contentBuf, maxContent, outContentLen, commandTimeoutMs(key, ceilingMs));
+  if (conf >= 0) {
+    if (sample) rttSample(key, (uint32_t)(esp_timer_get_time() - sentUs));
+  } else if (conf == PACKET_TIMEOUT) {
+    rttOverdue(key);
+  }
+  return conf;
+}
+
+// Sends a command and waits for its acknowledgement, re-sending up to
+// SENSOR_CMD_RETRIES times when the reply is overdue or corrupt. Only
+// for commands that are safe to repeat: GenImg, Image2Tz, Search,
+// LoadChar, TemplateCount and ReadIndex.
+static int exchangeCommand(uint8_t cmd, const uint8_t *params, uint16_t len, uint8_t *contentBuf = nullptr,
+                           size_t maxContent = 0, size_t *outContentLen = nullptr, uint32_t ceilingMs = SERIAL_READ_TIMEOUT_MS) {
+  int conf = PACKET_TIMEOUT;
+  for (uint8_t attempt = 0; attempt <= SENSOR_CMD_RETRIES; attempt++) {
+    flushSerialInput(mySerial, 10);
+    sendCommandPacket(mySerial, cmd, params, len);
+    conf = readCommandAck(cmd, esp_timer_get_time(), attempt == 0, contentBuf, maxContent, outContentLen, ceilingMs);
+    if (conf >= 0 || conf == PACKET_UNEXPECTED) break;
+    LOG_D("R307", "No reply to 0x%02X (attempt %u)", cmd, attempt + 1);
+  }
+  return conf;
+}
+
+// Sends a command once and waits for its acknowledgement. For commands
+// that change the library (RegModel, Store, Delete, Empty), where a lost
+// reply doesn't mean the command didn't run.
 static int sendCmdAndGetAck(uint8_t cmd, const uint8_t *params = nullptr, uint16_t len = 0, uint32_t timeoutMs = SERIAL_READ_TIMEOUT_MS) {
   flushSerialInput(mySerial, 10);
   sendCommandPacket(mySerial, cmd, params, len);
-  return readAck(mySerial, nullptr, 0, nullptr, timeoutMs);
+  return readCommandAck(cmd, esp_timer_get_time(), true, nullptr, 0, nullptr, timeoutMs);
 }
 
 // ---------------- Core Template Functions ----------------
-bool uploadTemplateFromModule(uint8_t pageID, const char *filename) {
-  uint8_t params[1] = { 0x01 };
+// UpChar of a CharBuffer. The data packets are copied into buf, or with
+// buf null only counted, and *outCrc (if given) is their CRC-32, built
+// packet by packet so a read-back needs no buffer.
+static bool receiveTemplate(uint8_t charBufferID, uint8_t *buf, size_t maxLen, size_t *outLen, uint32_t *outCrc = nullptr) {
+  uint8_t params[1] = { charBufferID };
   
   for (uint8_t attempt = 0; attempt < MAX_RETRY; ++attempt) {
     flushSerialInput(mySerial, 10);
     sendCommandPacket(mySerial, INS_UPCHAR, params, 1);
 
-    int conf = readAck(mySerial, nullptr, 0, nullptr, SERIAL_READ_TIMEOUT_MS);
+    int conf = readCommandAck(INS_UPCHAR, esp_timer_get_time(), attempt == 0);
     if (conf < 0) {
-      Serial.println("No initial ACK for UpChar");
+      LOG_W("R307", "No initial ACK for UpChar");
       continue;
     }
     if (conf != 0x00) {
-      Serial.printf("UpChar ACK error: 0x%02X\n", conf);
+      LOG_W("R307", "UpChar ACK error: 0x%02X", conf);
       delay(150);
       continue;
     }
 
-    File f = SD.open(filename, FILE_WRITE);
-    if (!f) {
-      Serial.printf("SD open write failed: %s\n", filename);
-      return false;
-    }
-
     bool finished = false;
+    bool restart = false;
     uint32_t start = millis();
     uint32_t totalReceived = 0;
+    uint32_t crc = 0;
+    int64_t lastPacketUs = esp_timer_get_time();
 
     while (!finished && (millis() - start) < 15000) {
       uint8_t content[520];
       size_t contentLen = 0;
-      int pid = readPacket(mySerial, content, sizeof(content), &contentLen, SERIAL_READ_TIMEOUT_MS);
+      int pid = readPacket(mySerial, content, sizeof(content), &contentLen,
+                           commandTimeoutMs(RTT_DATA_PACKET, SERIAL_READ_TIMEOUT_MS));
 
+      // A lost or corrupt data packet can't be re-requested; restart the UpChar
+      if (pid == PACKET_CHECKSUM) {
+        LOG_W("R307", "Corrupt data packet after %lu bytes; retrying", totalReceived);
+        restart = true;
+        break;
+      }
       if (pid < 0) {
-        f.close();
-        Serial.println("Timeout reading data packet");
-        return false;
+        rttOverdue(RTT_DATA_PACKET);
+        LOG_W("R307", "Timeout reading data packet after %lu bytes; retrying", totalReceived);
+        restart = true;
+        break;
       }
+      int64_t nowUs = esp_timer_get_time();
+      rttSample(RTT_DATA_PACKET, (uint32_t)(nowUs - lastPacketUs));
+      lastPacketUs = nowUs;
 
       if (pid == PID_DATA || pid == PID_END) {
+        if (totalReceived + contentLen > maxLen) {
+          LOG_W("R307", "Template larger than %u bytes", maxLen);
+          return false;
+        }
         if (contentLen > 0) {
-          f.write(content, contentLen);
+          if (buf) memcpy(buf + totalReceived, content, contentLen);
+          crc = crc32_le(crc, content, contentLen);
           totalReceived += contentLen;
         }
         
@@ -197,51 +406,40 @@ bool uploadTemplateFromModule(uint8_t pageID, const char *filename) {
         finished = true;
         break;
       } else {
-        f.close();
-        Serial.printf("Unexpected PID during UpChar: 0x%02X\n", pid);
+        LOG_W("R307", "Unexpected PID during UpChar: 0x%02X", pid);
         return false;
       }
     }
-    f.close();
+    if (restart) continue;
 
     if (finished) {
-      Serial.printf("✅ Template exported: %s (%lu bytes)\n", filename, totalReceived);
+      LOG_D("R307", "Template received (%lu bytes)", totalReceived);
+      *outLen = totalReceived;
+      if (outCrc) *outCrc = crc;
       return true;
     }
   }
   return false;
 }
 
-bool downloadTemplateToModuleWithVerify(uint8_t charBufferID, const char *filename) {
-  File f = SD.open(filename, FILE_READ);
-  if (!f) {
-    Serial.println("Failed to open template file");
-    return false;
-  }
-  
-  uint32_t totalSize = f.size();
-  
-  // Check if file size is reasonable
-  if (totalSize == 0 || totalSize > 2048) {
-    Serial.printf("Invalid template size: %lu bytes\n", totalSize);
-    f.close();
-    return false;
-  }
-  
-  uint8_t *templateData = (uint8_t *)malloc(totalSize);
-  if (!templateData) {
-    Serial.println("Memory allocation failed");
-    f.close();
-    return false;
-  }
-  
-  if (f.read(templateData, totalSize) != totalSize) {
-    Serial.println("Failed to read template data");
-    free(templateData);
-    f.close();
+// Receives the template in CharBuffer1 into buf; *outLen is its size
+bool uploadTemplateFromModule(uint8_t *buf, size_t maxLen, size_t *outLen) {
+  return receiveTemplate(0x01, buf, maxLen, outLen);
+}
+
+// DownChar into a CharBuffer. The sensor doesn't acknowledge data
+// packets, so each one is drained from the UART and then given
+// SENSOR_DOWNCHAR_GAP_MS to be taken in. With verify, the buffer is then read back
+// with UpChar and the CRC-32 of what came back compared with the one
+// taken while sending; the sensor can't take a DownChar up part way, so
+// a mismatch repeats the whole packet sequence.
+bool downloadTemplateToModuleWithVerify(uint8_t charBufferID, const uint8_t *templateData, size_t totalSize,
+                                        bool verify = TEMPLATE_VERIFY_DOWNLOAD) {
+  // Check if template size is reasonable
+  if (totalSize == 0 || totalSize > TEMPLATE_MAX_BYTES) {
+    LOG_W("R307", "Invalid template size: %u bytes", totalSize);
     return false;
   }
-  f.close();
 
   for (uint8_t attempt = 0; attempt < MAX_RETRY; ++attempt) {
     flushSerialInput(mySerial, 100);
@@ -249,15 +447,16 @@ bool downloadTemplateToModuleWithVerify(uint8_t charBufferID, const char *filena
     uint8_t params[1] = { charBufferID };
     sendCommandPacket(mySerial, INS_DOWNCHAR, params, 1);
 
-    int conf = readAck(mySerial, nullptr, 0, nullptr, 3000);
+    int conf = readCommandAck(INS_DOWNCHAR, esp_timer_get_time(), attempt == 0, nullptr, 0, nullptr, 3000);
     if (conf != 0x00) {
-      Serial.printf("DownChar command failed: 0x%02X, attempt %d\n", conf, attempt + 1);
+      LOG_W("R307", "DownChar command failed: 0x%02X, attempt %d", conf, attempt + 1);
       delay(500);
       continue;
     }
 
     const size_t CHUNK_SIZE = 128;
     uint32_t sent = 0;
+    uint32_t sentCrc = 0;
 
     while (sent < totalSize) {
       size_t chunkSize = min((size_t)(totalSize - sent), CHUNK_SIZE);
@@ -275,65 +474,70 @@ bool downloadTemplateToModuleWithVerify(uint8_t charBufferID, const char *filena
       uint32_t sum = pid + ((lengthField >> 8) & 0xFF) + (lengthField & 0xFF);
       for (size_t i = 0; i < chunkSize; i++) sum += templateData[sent + i];
       writeUint16BigEndian(mySerial, (uint16_t)sum);
+      mySerial.flush();
+      delay(SENSOR_DOWNCHAR_GAP_MS);
       
+      sentCrc = crc32_le(sentCrc, templateData + sent, chunkSize);
       sent += chunkSize;
-      delay(50);
     }
 
-    delay(300);
-    free(templateData);
-    return true;
+    if (!verify) {
+      delay(SENSOR_DOWNCHAR_SETTLE_MS);
+      return true;
+    }
+
+    size_t backLen = 0;
+    uint32_t backCrc = 0;
+    if (!receiveTemplate(charBufferID, nullptr, TEMPLATE_MAX_BYTES, &backLen, &backCrc)) {
+      LOG_W("R307", "No read-back after DownChar, attempt %d", attempt + 1);
+      continue;
+    }
+    if (backLen == totalSize && backCrc == sentCrc) {
+      packetStats.downloadsVerified++;
+      return true;
+    }
+    packetStats.downloadMismatches++;
+    LOG_W("R307", "DownChar read back as %u bytes, crc %08lX (sent %u, %08lX); resending",
+          backLen, (unsigned long)backCrc, totalSize, (unsigned long)sentCrc);
   }
 
-  free(templateData);
   return false;
 }
 
-bool validateTemplate(const char *filename) {
-  File f = SD.open(filename, FILE_READ);
-  if (!f) {
-    Serial.printf("Cannot open: %s\n", filename);
+bool validateTemplate(const uint8_t *data, size_t size) {
+  if (size >= 2 && data[0] == 0xEF && data[1] == 0x01) {
+    LOG_W("R307", "Old format detected - re-export needed");
     return false;
   }
 
-  uint32_t fileSize = f.size();
-  uint8_t header[4];
-  f.read(header, 4);
-  f.close();
-
-  if (header[0] == 0xEF && header[1] == 0x01) {
-    Serial.println("❌ Old format detected - re-export needed");
+  if (size < 100 || size > 1024) {
+    LOG_W("R307", "Invalid size: %u bytes", size);
     return false;
   }
 
-  if (fileSize < 100 || fileSize > 1024) {
-    Serial.printf("❌ Invalid size: %lu bytes\n", fileSize);
-    return false;
-  }
-
-  Serial.printf("✅ Valid template: %lu bytes\n", fileSize);
+  LOG_D("R307", "Valid template: %u bytes", size);
   return true;
 }
 
 bool captureFinger() {
-  int r = sendCmdAndGetAck(CMD_GENIMG);
+  int r = exchangeCommand(CMD_GENIMG, nullptr, 0);
   if (r == 0x00) return true;
-  Serial.printf("GenImg failed: 0x%02X\n", r);
+  LOG_W("R307", "GenImg failed: 0x%02X", r);
   return false;
 }
 
 bool convertToTemplate(uint8_t bufferID) {
   uint8_t p[1] = { bufferID };
-  int r = sendCmdAndGetAck(CMD_IMAGE2TZ, p, 1);
+  int r = exchangeCommand(CMD_IMAGE2TZ, p, 1);
   if (r == 0x00) return true;
-  Serial.printf("Image2TZ failed: 0x%02X\n", r);
+  LOG_W("R307", "Image2TZ failed: 0x%02X", r);
   return false;
 }
 
 bool createModel() {
   int r = sendCmdAndGetAck(CMD_REGMODEL);
   if (r == 0x00) return true;
-  Serial.printf("RegModel failed: 0x%02X\n", r);
+  LOG_W("R307", "RegModel failed: 0x%02X", r);
   return false;
 }
 
@@ -341,7 +545,7 @@ bool storeModel(uint8_t bufferID, uint16_t pageID) {
   uint8_t p[3] = { bufferID, (uint8_t)(pageID >> 8), (uint8_t)(pageID & 0xFF) };
   int r = sendCmdAndGetAck(CMD_STORE, p, 3);
   if (r == 0x00) return true;
-  Serial.printf("Store failed: 0x%02X\n", r);
+  LOG_W("R307", "Store failed: 0x%02X", r);
   return false;
 }
 
@@ -350,45 +554,58 @@ bool deleteTemplate(uint16_t pageID, uint16_t count = 1) {
                    (uint8_t)(count >> 8), (uint8_t)(count & 0xFF) };
   int r = sendCmdAndGetAck(CMD_DELETE, p, 4);
   if (r == 0x00) return true;
-  Serial.printf("Delete failed: 0x%02X\n", r);
+  LOG_W("R307", "Delete failed: 0x%02X", r);
   return false;
 }
 
 bool clearDatabase() {
   int r = sendCmdAndGetAck(CMD_EMPTY);
   if (r == 0x00) return true;
-  Serial.printf("Clear DB failed: 0x%02X\n", r);
+  LOG_W("R307", "Clear DB failed: 0x%02X", r);
   return false;
 }
 
+// Occupancy bitmap for sensor slots page*256 .. page*256+255 (bit n of
+// byte n/8 is slot n); true if the sensor answered
+bool readIndexTable(uint8_t page, uint8_t bitmap[32]) {
+  uint8_t params[1] = { page };
+  uint8_t resp[33];
+  size_t got = 0;
+  int conf = exchangeCommand(CMD_READINDEX, params, 1, resp, sizeof(resp), &got);
+  if (conf != 0x00 || got < sizeof(resp)) {
+    LOG_W("R307", "ReadIndexTable page %u failed: %d", page, conf);
+    return false;
+  }
+  memcpy(bitmap, resp + 1, 32);
+  return true;
+}
+
 int getTemplateCount() {
-  flushSerialInput(mySerial, 10);
-  sendCommandPacket(mySerial, CMD_TEMPLATECOUNT, nullptr, 0);
   uint8_t buf[64];
   size_t gotLen = 0;
-  int conf = readAck(mySerial, buf, sizeof(buf), &gotLen, SERIAL_READ_TIMEOUT_MS);
+  int conf = exchangeCommand(CMD_TEMPLATECOUNT, nullptr, 0, buf, sizeof(buf), &gotLen);
   if (conf < 0) {
-    Serial.println("Failed to get template count");
+    LOG_W("R307", "Failed to get template count");
     return -1;
   }
   if (gotLen >= 3) {
     uint16_t count = (uint16_t)buf[1] << 8 | (uint16_t)buf[2];
-    Serial.printf("Templates stored: %u\n", count);
+    LOG_D("R307", "Templates stored: %u", count);
     return (int)count;
   }
-  Serial.println("Unexpected template count response");
+  LOG_W("R307", "Unexpected template count response");
   return -1;
 }
 
-bool searchFinger(uint8_t bufferID, uint16_t &foundPage, uint16_t &score) {
-  uint8_t params[6] = { bufferID, 0x00, 0x00, 0x01, 0x2C, 0x00 };
-  flushSerialInput(mySerial, 10);
-  sendCommandPacket(mySerial, CMD_SEARCH, params, 6);
+bool searchFinger(uint8_t bufferID, uint16_t &foundPage, uint16_t &score,
+                  uint16_t startPage = 0, uint16_t pageCount = FINGER_SLOT_COUNT) {
+  uint8_t params[6] = { bufferID, (uint8_t)(startPage >> 8), (uint8_t)(startPage & 0xFF),
+                        (uint8_t)(pageCount >> 8), (uint8_t)(pageCount & 0xFF), 0x00 };
   uint8_t resp[16];
   size_t got = 0;
-  int conf = readAck(mySerial, resp, sizeof(resp), &got, SERIAL_READ_TIMEOUT_MS);
+  int conf = exchangeCommand(CMD_SEARCH, params, 6, resp, sizeof(resp), &got);
   if (conf < 0) {
-    Serial.println("Search read timeout");
+    LOG_W("R307", "Search read timeout");
     return false;
   }
   if (conf == 0x00 && got >= 5) {
@@ -399,6 +616,16 @@ bool searchFinger(uint8_t bufferID, uint16_t &foundPage, uint16_t &score) {
   return false;
 }
 
+// Slot already holding the finger in bufferID, or 0; a template is
+// checked with this before it is stored so a finger isn't enrolled twice
+uint16_t findEnrolledDuplicate(uint8_t bufferID, uint16_t startPage = 1, uint16_t pageCount = FINGER_SLOT_COUNT) {
+  uint16_t page = 0;
+  uint16_t score = 0;
+  if (pageCount == 0 || !searchFinger(bufferID, page, score, startPage, pageCount)) return 0;
+  LOG_D("R307", "Template matches slot %u (score %u)", page, score);
+  return page;
+}
+
 void sendEndPacket() {
   uint16_t lf = 2;
   mySerial.write(0xEF);
@@ -411,25 +638,23 @@ void sendEndPacket() {
 }
 
 bool checkForAck(uint32_t timeoutMs) {
-  Serial.println("Checking for ACK...");
+  LOG_V("R307", "Checking for ACK...");
   int ack = readAck(mySerial, nullptr, 0, nullptr, timeoutMs);
   if (ack == 0x00) {
-    Serial.println("Got success ACK!");
+    LOG_V("R307", "Got success ACK!");
     return true;
   } else if (ack >= 0) {
-    Serial.printf("Got ACK with code: 0x%02X\n", ack);
+    LOG_D("R307", "Got ACK with code: 0x%02X", ack);
   } else {
-    Serial.println("No ACK received");
+    LOG_W("R307", "No ACK received");
   }
   return false;
 }
 
 int findNextAvailableTemplateID() {
-  for (int id = 1; id <= 300; id++) {
+  for (int id = 1; id <= FINGER_SLOT_COUNT; id++) {
     uint8_t params[3] = { 0x01, (uint8_t)((id >> 8) & 0xFF), (uint8_t)(id & 0xFF) };
-    flushSerialInput(mySerial, 10);
-    sendCommandPacket(mySerial, CMD_LOADCHAR, params, 3);
-    int conf = readAck(mySerial, nullptr, 0, nullptr, SERIAL_READ_TIMEOUT_MS);
+    int conf = exchangeCommand(CMD_LOADCHAR, params, 3);
     if (conf != 0x00) {
       return id;
     }
@@ -438,7 +663,7 @@ int findNextAvailableTemplateID() {
 }
 
 String generateFingerprintID(int id) {
-  DateTime now = rtc.now();
+  DateTime now = timeNow();
   String uniqueId = "FPR" + 
                    device_id.substring(device_id.length() - 3) +
                    String(now.year()) + 
@@ -499,75 +724,84 @@ bool appendTemplateToSD(const String &filename, const String &data) {
   return false;
 }
 
-bool exportRealFingerprintTemplate(int id) {
-  Serial.printf("Exporting template for ID: %d using raw protocol\n", id);
-  
-  if (!SD.exists("/templates")) {
-    SD.mkdir("/templates");
+// Uploads the template already in CharBuffer1 into the pack as slot id.
+// A template identical to the packed copy isn't rewritten; *unchanged
+// reports that.
+bool exportCharBufferTemplate(int id, bool *unchanged = nullptr) {
+  uint8_t *data = (uint8_t *)malloc(TEMPLATE_MAX_BYTES);
+  if (!data) {
+    Serial.println("Memory allocation failed");
+    return false;
   }
   
-  char filename[32];
-  sprintf(filename, "/templates/fp_%03d.bin", id);
+  size_t size = 0;
+  bool ok = uploadTemplateFromModule(data, TEMPLATE_MAX_BYTES, &size);
+  const PackEntry *packed = packFind(id);
+  bool same = ok && packed && packed->size == size && packed->crc == templateCrc(data, size);
+  if (ok && !same) ok = packPut(id, employeeForSlot(id), data, size);
+  free(data);
+  
+  if (unchanged) *unchanged = same;
+  if (same) {
+    Serial.printf("Template unchanged: ID %d\n", id);
+  } else if (ok) {
+    Serial.printf("✅ Template exported: ID %d -> %s (%d bytes)\n", id, packRef(id).c_str(), size);
+  }
+  return ok;
+}
+
+// Loads slot id into CharBuffer1 and exports it (see exportCharBufferTemplate())
+bool exportRealFingerprintTemplate(int id, bool *unchanged = nullptr) {
+  Serial.printf("Exporting template for ID: %d using raw protocol\n", id);
   
   uint8_t loadParams[3] = { 0x01, (uint8_t)((id >> 8) & 0xFF), (uint8_t)(id & 0xFF) };
-  flushSerialInput(mySerial, 10);
-  sendCommandPacket(mySerial, CMD_LOADCHAR, loadParams, 3);
-  int conf = readAck(mySerial, nullptr, 0, nullptr, SERIAL_READ_TIMEOUT_MS);
+  int conf = exchangeCommand(CMD_LOADCHAR, loadParams, 3);
   if (conf != 0x00) {
     Serial.printf("LoadChar failed for ID %d: 0x%02X\n", id, conf);
     return false;
   }
-  
-  if (uploadTemplateFromModule(id, filename)) {
-    Serial.printf("✅ Template exported: ID %d -> %s\n", id, filename);
-    
-    String metaFilename = "/templates/fp_" + String(id) + ".dat";
-    String metadata = "R307_RAW_TEMPLATE\n";
-    metadata += "ID:" + String(id) + "\n";
-    metadata += "NAME:" + getNameByID(id) + "\n";
-    metadata += "DEVICE:" + device_id + "\n";
-    metadata += "TIMESTAMP:" + String(rtc.now().unixtime()) + "\n";
-    
-    File sizeCheck = SD.open(filename, FILE_READ);
-    if (sizeCheck) {
-      metadata += "SIZE:" + String(sizeCheck.size()) + "\n";
-      sizeCheck.close();
-    }
-    
-    metadata += "FORMAT:RAW_R307_BINARY\n";
-    metadata += "PROTOCOL:UPCHAR_0x08\n";
-    
-    if (saveTemplateToSD(metaFilename, metadata)) {
-      Serial.printf("Metadata saved: %s\n", metaFilename.c_str());
-    }
-    
-    return true;
-  }
-  
-  return false;
+  return exportCharBufferTemplate(id, unchanged);
 }
 
-bool importRealFingerprintTemplate(int id, const String &filename) {
-  Serial.printf("Importing template to ID: %d from: %s\n", id, filename.c_str());
+// Downloads the template packed for packSlot and stores it in sensor slot id
+bool importRealFingerprintTemplate(int id, uint16_t packSlot) {
+  Serial.printf("Importing template to ID: %d from: %s\n", id, packRef(packSlot).c_str());
   
-  String fullPath = "/templates/" + filename;
-  if (!SD.exists(fullPath)) {
-    Serial.println("Template file not found: " + fullPath);
+  uint8_t *data = (uint8_t *)malloc(TEMPLATE_MAX_BYTES);
+  if (!data) {
+    Serial.println("Memory allocation failed");
+    return false;
+  }
+  
+  int size = packRead(packSlot, data, TEMPLATE_MAX_BYTES);
+  if (size < 0) {
+    Serial.printf("No packed template for slot %u\n", packSlot);
+    free(data);
     return false;
   }
 
-  if (!validateTemplate(fullPath.c_str())) {
+  if (!validateTemplate(data, size)) {
     Serial.println("Template validation failed");
+    free(data);
+    return false;
+  }
+
+  bool downloaded = downloadTemplateToModuleWithVerify(1, data, size);
+  free(data);
+
+  uint16_t duplicate = downloaded ? findEnrolledDuplicate(1) : 0;
+  if (duplicate) {
+    Serial.printf("Template already enrolled in slot %d; not stored\n", duplicate);
     return false;
   }
 
-  if (downloadTemplateToModuleWithVerify(1, fullPath.c_str())) {
+  if (downloaded) {
     if (storeModel(1, (uint16_t)id)) {
-      Serial.printf("✅ Template imported successfully: %s -> ID %d\n", filename.c_str(), id);
+      Serial.printf("✅ Template imported successfully: slot %u -> ID %d\n", packSlot, id);
       
-      String logEntry = "IMPORT_SUCCESS: FILE=" + filename + 
+      String logEntry = "IMPORT_SUCCESS: FILE=" + packRef(packSlot) + 
                        ", TARGET_ID=" + String(id) +
-                       ", TIME=" + String(rtc.now().unixtime()) + 
+                       ", TIME=" + String(timeNowUnix()) + 
                        ", DEVICE=" + device_id + "\n";
       appendTemplateToSD("/templates/import_log.txt", logEntry);
       
@@ -587,7 +821,7 @@ bool exportFingerprintTemplateAsDat(int id) {
 }
 
 bool importFingerprintTemplateFromDat(int id, const String &filename) {
-  return importRealFingerprintTemplate(id, filename);
+  return importRealFingerprintTemplate(id, packRefSlot(filename));
 }
 
 bool exportFingerprintTemplate(int id) {
@@ -599,182 +833,9 @@ bool importFingerprintTemplate(int id, const String &templateData) {
   return false;
 }
 
-void exportAllTemplates() {
-  display.clearDisplay();
-  display.setTextSize(1);
-  display.setCursor(0, 0);
-  display.println("Exporting Templates...");
-  display.println("Format: Raw Binary");
-  display.display();
-
-  if (!SD.exists("/templates")) {
-    SD.mkdir("/templates");
-  }
-
-  int exportedCount = 0;
-  int totalCount = getTemplateCount();
-  
-  if (totalCount <= 0) {
-    display.clearDisplay();
-    display.setCursor(0, 0);
-    display.println("No templates found");
-    display.display();
-    delay(2000);
-    return;
-  }
-
-  display.clearDisplay();
-  display.setCursor(0, 0);
-  display.println("Exporting Templates...");
-  display.setCursor(0, 16);
-  display.printf("Total: %d", totalCount);
-  display.display();
-  
-  for (int id = 1; id <= 300; id++) {
-    uint8_t params[3] = { 0x01, (uint8_t)((id >> 8) & 0xFF), (uint8_t)(id & 0xFF) };
-    flushSerialInput(mySerial, 10);
-    sendCommandPacket(mySerial, CMD_LOADCHAR, params, 3);
-    int conf = readAck(mySerial, nullptr, 0, nullptr, SERIAL_READ_TIMEOUT_MS);
-    
-    if (conf == 0x00) {
-      display.clearDisplay();
-      display.setCursor(0, 0);
-      display.println("Exporting...");
-      display.setCursor(0, 16);
-      display.printf("ID: %d", id);
-      display.setCursor(0, 32);
-      display.printf("Progress: %d/%d", exportedCount + 1, totalCount);
-      display.display();
-      
-      if (exportRealFingerprintTemplate(id)) {
-        exportedCount++;
-      }
-      delay(500);
-    }
-  }
-
-  display.clearDisplay();
-  display.setCursor(0, 0);
-  display.println("Export Complete");
-  display.setCursor(0, 16);
-  display.printf("Exported: %d/%d", exportedCount, totalCount);
-  display.setCursor(0, 32);
-  display.println("Check /templates/");
-  display.println("on SD card");
-  display.display();
-  
-  buzzerSuccess();
-  delay(3000);
-}
-
-void importTemplateFromFile() {
-  display.clearDisplay();
-  display.setTextSize(1);
-  display.setCursor(0, 0);
-  display.println("Template Import");
-  display.setCursor(0, 16);
-  display.println("Select .bin file");
-  display.setCursor(0, 40);
-  display.println("Press to continue");
-  display.display();
-
-  unsigned long startTime = millis();
-  while (millis() - startTime < 10000) {
-    if (digitalRead(BUTTON_PIN) == LOW) {
-      delay(50);
-      if (digitalRead(BUTTON_PIN) == LOW) {
-        File root = SD.open("/templates");
-        String binFile = "";
-        
-        while (true) {
-          File entry = root.openNextFile();
-          if (!entry) break;
-          String fileName = String(entry.name());
-          if (!entry.isDirectory() && fileName.endsWith(".bin")) {
-            binFile = fileName;
-            break;
-          }
-          entry.close();
-        }
-        root.close();
-        
-        if (binFile.length() > 0) {
-          int newId = findNextAvailableTemplateID();
-          if (newId != -1) {
-            display.clearDisplay();
-            display.setCursor(0, 0);
-            display.println("Importing...");
-            display.setCursor(0, 16);
-            display.printf("File: %s", binFile.c_str());
-            display.setCursor(0, 32);
-            display.printf("To ID: %d", newId);
-            display.display();
-            
-            if (importRealFingerprintTemplate(newId, binFile)) {
-              successMessage("Imported: " + binFile);
-            } else {
-              failMessage("Import failed");
-            }
-          } else {
-            failMessage("No space");
-          }
-        } else {
-          failMessage("No .bin files");
-        }
-        return;
-      }
-    }
-    delay(100);
-  }
-  
-  display.clearDisplay();
-  display.setCursor(0, 0);
-  display.println("Import cancelled");
-  display.display();
-  delay(2000);
-}
-
 void listTemplateFiles() {
-  Serial.println("\n=== Available Template Files ===");
-  
-  if (!SD.exists("/templates")) {
-    Serial.println("No templates directory found");
-    return;
-  }
-  
-  File root = SD.open("/templates");
-  if (!root) {
-    Serial.println("Failed to open templates directory");
-    return;
-  }
-  
-  int datCount = 0;
-  int binCount = 0;
-  int totalSize = 0;
-  
-  while (true) {
-    File entry = root.openNextFile();
-    if (!entry) break;
-    
-    String fileName = String(entry.name());
-    if (!entry.isDirectory()) {
-      if (fileName.endsWith(".dat")) {
-        Serial.printf("  DAT: %s (%d bytes)\n", entry.name(), entry.size());
-        datCount++;
-      } else if (fileName.endsWith(".bin")) {
-        Serial.printf("  BIN: %s (%d bytes)\n", entry.name(), entry.size());
-        binCount++;
-        totalSize += entry.size();
-      }
-    }
-    entry.close();
-  }
-  root.close();
-  
-  Serial.printf("Total: %d .dat files, %d .bin files\n", datCount, binCount);
-  Serial.printf("Total binary size: %d bytes\n", totalSize);
+  printPackIndex();
   Serial.println("Format: Raw R307 binary (UpChar/DownChar protocol)");
-  Serial.println("================================\n");
 }
 
 void showTemplateTransferHelp() {
@@ -785,7 +846,7 @@ void showTemplateTransferHelp() {
   Serial.println("• LOADCHAR (0x07) - Load template to buffer");
   Serial.println("• STORE (0x06) - Save template to database");
   Serial.println("• Template format: Raw binary (512-768 bytes)");
-  Serial.println("• Files: .bin (raw data) + .dat (metadata)");
+  Serial.println("• Storage: one pack file, indexed by slot");
   Serial.println("===================================\n");
 }
 
@@ -829,118 +890,113 @@ String templateToBase64(const uint8_t* data, size_t length) {
   return result;
 }
 
-// Read template from SD card and convert to Base64
-String readTemplateAsBase64(const String &filename) {
-  File file = SD.open(filename, FILE_READ);
-  if (!file) {
-    Serial.println("Failed to open template file: " + filename);
+struct TemplateUploadBody {
+  size_t size;         // Raw template bytes
+  size_t encodedSize;  // Run-length encoded bytes; 0 if not encoded
+  bool sealed;         // AES-GCM sealed with the upload key
+};
+
+// Read a packed template (a packRef()) and convert to Base64, run-length
+// encoded first if asked, and sealed with the upload key (sealAad as
+// associated data) if one is given and the server has provisioned a key
+String readTemplateAsBase64(const String &templateRef, TemplateUploadBody *out = nullptr,
+                            bool encode = false, const String &sealAad = String()) {
+  uint16_t slot = packRefSlot(templateRef);
+  if (!packFind(slot)) {
+    Serial.println("Template not found: " + templateRef);
     return "";
   }
   
-  size_t fileSize = file.size();
-  if (fileSize == 0 || fileSize > 2048) {
-    Serial.printf("Invalid template size: %d bytes\n", fileSize);
-    file.close();
-    return "";
-  }
-  
-  uint8_t* buffer = (uint8_t*)malloc(fileSize);
+  uint8_t* buffer = (uint8_t*)malloc(TEMPLATE_MAX_BYTES);
   if (!buffer) {
     Serial.println("Memory allocation failed");
-    file.close();
     return "";
   }
   
-  size_t bytesRead = file.read(buffer, fileSize);
-  file.close();
-  
-  if (bytesRead != fileSize) {
+  int size = packRead(slot, buffer, TEMPLATE_MAX_BYTES);
+  if (size <= 0) {
     Serial.println("Failed to read complete template");
     free(buffer);
     return "";
   }
   
-  String base64Data = templateToBase64(buffer, fileSize);
+  const uint8_t *body = buffer;
+  size_t bodySize = size;
+  uint8_t *encoded = encode ? (uint8_t *)malloc(templateEncodedBound(size)) : nullptr;
+  if (encoded) {
+    bodySize = templateEncode(buffer, size, encoded);
+    body = encoded;
+  }
+  
+  size_t encodedSize = encoded ? bodySize : 0;
+  
+  uint8_t *sealed = nullptr;
+  if (sealAad.length() && templateKeyAvailable(TEMPLATE_KEY_UPLOAD)) {
+    sealed = (uint8_t *)malloc(bodySize + TEMPLATE_SEAL_OVERHEAD);
+    size_t sealedSize = sealed ? templateSeal(TEMPLATE_KEY_UPLOAD, body, bodySize, sealed,
+                                              (const uint8_t *)sealAad.c_str(), sealAad.length()) : 0;
+    if (!sealedSize) {
+      // Never fall back to sending it in the clear
+      Serial.println("Failed to seal template");
+      free(buffer);
+      free(encoded);
+      free(sealed);
+      return "";
+    }
+    body = sealed;
+    bodySize = sealedSize;
+  }
+  
+  String base64Data = templateToBase64(body, bodySize);
   free(buffer);
+  free(encoded);
+  free(sealed);
   
   Serial.printf("Template converted to Base64: %d bytes -> %d chars\n", 
-                fileSize, base64Data.length());
+                bodySize, base64Data.length());
   
+  if (out) *out = { (size_t)size, encodedSize, sealed != nullptr };
   return base64Data;
 }
 
-// Enhanced function to capture and save template with full data
-bool captureAndSaveTemplateWithData(int id, const String &name) {
+// Enhanced function to capture and save template with full data.
+// inCharBuffer: the model is still in CharBuffer1 (straight after
+// createModel/storeModel), so it is uploaded without reloading the slot.
+bool captureAndSaveTemplateWithData(int id, const String &name, bool inCharBuffer = false) {
   Serial.printf("Capturing template for ID %d with full data\n", id);
   
-  // Ensure templates directory exists
-  if (!SD.exists("/templates")) {
-    SD.mkdir("/templates");
-  }
-  
-  // Generate template filename
-  char templateFile[40];
-  sprintf(templateFile, "/templates/fp_%03d.bin", id);
-  
-  // Load the fingerprint template into buffer 1
-  uint8_t loadParams[3] = { 0x01, (uint8_t)((id >> 8) & 0xFF), (uint8_t)(id & 0xFF) };
-  flushSerialInput(mySerial, 10);
-  sendCommandPacket(mySerial, CMD_LOADCHAR, loadParams, 3);
-  int conf = readAck(mySerial, nullptr, 0, nullptr, SERIAL_READ_TIMEOUT_MS);
-  
-  if (conf != 0x00) {
-    Serial.printf("Failed to load template for ID %d: 0x%02X\n", id, conf);
-    return false;
-  }
-  
-  // Upload (export) the template from sensor to SD card
-  if (!uploadTemplateFromModule(id, templateFile)) {
+  // Upload (export) the template from sensor into the template pack
+  if (!(inCharBuffer ? exportCharBufferTemplate(id) : exportRealFingerprintTemplate(id))) {
     Serial.println("Failed to export template to SD card");
     return false;
   }
   
-  // Verify the exported file
-  if (!SD.exists(templateFile)) {
-    Serial.println("Template file not created");
-    return false;
-  }
-  
-  File checkFile = SD.open(templateFile, FILE_READ);
-  size_t templateSize = checkFile.size();
-  checkFile.close();
-  
-  if (templateSize < 100 || templateSize > 2048) {
-    Serial.printf("Invalid template size: %d bytes\n", templateSize);
+  String templateFile = packRef(id);
+  const PackEntry *packed = packFind(id);
+  if (!packed || packed->size < 100) {
+    Serial.printf("Invalid template size: %d bytes\n", packed ? packed->size : 0);
     return false;
   }
   
-  Serial.printf("✅ Template saved: %s (%d bytes)\n", templateFile, templateSize);
-  
   // Generate metadata
-  DateTime now = rtc.now();
-  String timestamp = String(now.year()) + "-" + 
-                    (now.month() < 10 ? "0" : "") + String(now.month()) + "-" + 
-                    (now.day() < 10 ? "0" : "") + String(now.day()) + "T" + 
-                    (now.hour() < 10 ? "0" : "") + String(now.hour()) + ":" + 
-                    (now.minute() < 10 ? "0" : "") + String(now.minute()) + ":" + 
-                    (now.second() < 10 ? "0" : "") + String(now.second()) + "Z";
+  char timestamp[TS_ISO_LEN];
+  formatIsoTimestamp(timestamp, timeNowUnix());
   
   // Generate unique finger_id
   String finger_id = generateFingerprintID(id);
   
-  // Save to pending sync file with template path
-  String record = String(id) + "," + name + "," + timestamp + "," + 
-                  finger_id + "," + String(templateFile);
+  // Save to pending sync file with template path; emp_id is the slot's
+  // group. The template is already flushed to the pack, and the record
+  // goes out in a single write, so the queue never names a missing
+  // template or holds half a line.
+  String record = String(employeeForSlot(id)) + "," + name + "," + timestamp + "," + 
+                  finger_id + "," + templateFile + "\n";
   
-  File pendingFile = SD.open(PENDING_FINGERPRINTS_FILE, FILE_APPEND);
-  if (!pendingFile) {
+  if (!appendToSD(PENDING_FINGERPRINTS_FILE.c_str(), record.c_str(), record.length())) {
     Serial.println("Failed to save to pending queue");
     return false;
   }
   
-  pendingFile.println(record);
-  pendingFile.close();
-  
   Serial.println("✅ Template queued for server sync");
   return true;
 }
@@ -0,0 +1,575 @@
+#ifndef TEMPLATE_PACK_H
+#define TEMPLATE_PACK_H
+
+#include "config.h"
+#include "globals.h"
+#include "time_service.h"
+#include "log.h"
+#include "employee_groups.h"
+#include "template_codec.h"
+#include "template_crypto.h"
+#include "scheduler.h"
+#include "rom/crc.h"
+
+// Exported sensor templates live in one pack file instead of a .bin/.dat
+// pair per slot, so nothing has to walk the /templates directory. The
+// file is a header, a fixed index with one entry per sensor slot, then
+// template data in the order it was written:
+//
+//   PackHeader | PackEntry[FINGER_SLOT_COUNT] | data ...
+//
+// Slot N's entry sits at a fixed offset and the whole index is kept in
+// RAM, so a lookup never touches the card. Re-exporting a slot appends
+// the new data and rewrites only its entry; the old copy is dead space
+// until packCompact() rewrites the file, which happens by itself once
+// more than half the data region is dead. Data is flushed before its
+// index entry is written, so a reset mid-export leaves the old entry.
+//
+// Templates are stored run-length encoded (template_codec.h) when that
+// is smaller. Once this device has a storage key (template_crypto.h)
+// they are also sealed, with the slot as associated data, so a card read
+// without the key yields no templates and an entry copied to another
+// slot fails to open. The sealed plaintext is one codec byte
+// (PACK_CODEC_*) and the body. Size and CRC always describe the raw
+// template, so callers see neither layer.
+//
+// The header names the device whose key sealed the pack (empty while it
+// is plain). A load rewrites the pack, sealed under this device's key,
+// when it is plain and a key has arrived, or when it was sealed by
+// another device and that device's key has been fetched. Version 1
+// packs (plain, shorter header) are always rewritten. Version 2 packs
+// were sealed under the retired fleet-wide key and are set aside like
+// any unreadable pack; re-export from the menu to refill.
+//
+// Only the loop task (menu, enrolment and scheduler jobs) uses the pack,
+// so there is no locking.
+
+const char PACK_MAGIC[4] = { 'T', 'P', 'K', '1' };
+const uint16_t PACK_VERSION = 3;
+const uint16_t PACK_VERSION_LEGACY = 1;
+const size_t PACK_OWNER_LEN = 16;
+
+enum PackCodec : uint8_t {
+  PACK_CODEC_RAW,
+  PACK_CODEC_RLE
+};
+
+struct PackHeader {
+  char magic[4];
+  uint16_t version;
+  uint16_t slots;
+  uint32_t dataEnd;    // Next append offset
+  uint32_t liveBytes;  // Data referenced by the index
+  char owner[PACK_OWNER_LEN];  // device_id whose key seals the data; empty = plain (not in v1)
+};
+
+struct PackEntry {
+  uint16_t slot;       // 0 = empty
+  uint16_t empId;
+  uint16_t size;        // Raw template bytes
+  uint16_t storedSize;  // Sealed bytes on SD (v1: encoded bytes; 0 = raw)
+  uint32_t crc;        // CRC-32 of the raw template
+  uint32_t timestamp;  // Unix time of export
+  uint32_t offset;
+};
+
+const uint32_t PACK_LEGACY_HEADER_SIZE = offsetof(PackHeader, owner);
+const uint32_t PACK_INDEX_OFFSET = sizeof(PackHeader);
+const uint32_t PACK_DATA_OFFSET = PACK_INDEX_OFFSET + FINGER_SLOT_COUNT * sizeof(PackEntry);
+
+static PackHeader packHeader;
+static PackEntry packIndex[FINGER_SLOT_COUNT];
+static bool packLoaded = false;
+
+static bool packPutAt(uint16_t slot, uint16_t empId, const uint8_t *data, uint16_t size, uint32_t timestamp);
+JobResult fetchTemplateKeysJob();
+
+uint32_t templateCrc(const uint8_t *data, size_t len) {
+  return crc32_le(0, data, len);
+}
+
+static uint16_t packStoredSize(const PackEntry &e) {
+  return e.storedSize ? e.storedSize : e.size;
+}
+
+static bool packSealed(const PackHeader &header) {
+  return header.version == PACK_VERSION && header.owner[0];
+}
+
+static bool packWriteHeader(File &f) {
+  return f.seek(0) && f.write((const uint8_t *)&packHeader, sizeof(packHeader)) == sizeof(packHeader);
+}
+
+static bool packWriteEntry(File &f, uint16_t slot) {
+  const PackEntry &e = packIndex[slot - 1];
+  bool ok = f.seek(PACK_INDEX_OFFSET + (slot - 1) * sizeof(PackEntry)) &&
+            f.write((const uint8_t *)&e, sizeof(e)) == sizeof(e) &&
+            packWriteHeader(f);
+  f.flush();
+  return ok;
+}
+
+static bool packWriteHeaderAndIndex(File &f) {
+  return packWriteHeader(f) && f.write((const uint8_t *)packIndex, sizeof(packIndex)) == sizeof(packIndex);
+}
+
+static bool packCreate() {
+  memset(packIndex, 0, sizeof(packIndex));
+  memset(&packHeader, 0, sizeof(packHeader));
+  memcpy(packHeader.magic, PACK_MAGIC, sizeof(PACK_MAGIC));
+  packHeader.version = PACK_VERSION;
+  packHeader.slots = FINGER_SLOT_COUNT;
+  packHeader.dataEnd = PACK_DATA_OFFSET;
+  if (templateKeyAvailable(TEMPLATE_KEY_STORAGE)) {
+    strncpy(packHeader.owner, device_id.c_str(), PACK_OWNER_LEN - 1);
+  }
+
+  File f = SD.open(TEMPLATE_PACK_FILE, FILE_WRITE);
+  if (!f) return false;
+  bool ok = packWriteHeaderAndIndex(f);
+  f.close();
+  return ok;
+}
+
+// One-time move of fp_NNN.bin files (and their .dat metadata) into the pack
+static void packMigrateLegacyFiles() {
+  File root = SD.open("/templates");
+  if (!root) return;
+
+  bool migrated[FINGER_SLOT_COUNT + 1] = {};
+  uint16_t count = 0;
+  for (File entry = root.openNextFile(); entry; entry = root.openNextFile()) {
+    String name = entry.name();
+    name = name.substring(name.lastIndexOf('/') + 1);
+    size_t size = entry.size();
+    int slot = 0;
+    if (!entry.isDirectory() && name.startsWith("fp_") && name.endsWith(".bin")) {
+      slot = name.substring(3, name.length() - 4).toInt();
+    }
+    if (slot >= 1 && slot <= FINGER_SLOT_COUNT && size > 0 && size <= TEMPLATE_MAX_BYTES) {
+      uint8_t *data = (uint8_t *)malloc(size);
+      if (data && entry.read(data, size) == size && packPutAt(slot, employeeForSlot(slot), data, size, timeNowUnix())) {
+        migrated[slot] = true;
+        count++;
+      }
+      free(data);
+    }
+    entry.close();
+  }
+  root.close();
+
+  for (int slot = 1; slot <= FINGER_SLOT_COUNT; slot++) {
+    if (!migrated[slot]) continue;
+    char path[32];
+    sprintf(path, "/templates/fp_%03d.bin", slot);
+    SD.remove(path);
+    sprintf(path, "/templates/fp_%d.dat", slot);
+    SD.remove(path);
+  }
+  if (count) LOG_I("PACK", "Moved %u template files into %s", count, TEMPLATE_PACK_FILE.c_str());
+}
+
+// Reads a current or version 1 header and index; false for any other
+// version or a damaged file
+static bool packReadHeaderAndIndex(File &f, PackHeader &header, PackEntry *index) {
+  memset(&header, 0, sizeof(header));
+  bool ok = f.read((uint8_t *)&header, PACK_LEGACY_HEADER_SIZE) == PACK_LEGACY_HEADER_SIZE &&
+            memcmp(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC)) == 0 &&
+            header.slots == FINGER_SLOT_COUNT;
+  if (ok && header.version == PACK_VERSION) {
+    ok = f.read((uint8_t *)header.owner, PACK_OWNER_LEN) == PACK_OWNER_LEN;
+    header.owner[PACK_OWNER_LEN - 1] = 0;
+  } else if (ok && header.version != PACK_VERSION_LEGACY) {
+    ok = false;
+  }
+  return ok && f.read((uint8_t *)index, FINGER_SLOT_COUNT * sizeof(PackEntry)) == FINGER_SLOT_COUNT * sizeof(PackEntry);
+}
+
+// Reads an entry's data from f, already positioned at it, into buf as
+// the raw template; its size, or -1 if it is corrupt or fails to open
+static int packReadEntry(File &f, const PackEntry &e, const PackHeader &header, uint8_t *buf, size_t maxLen) {
+  if (e.size > maxLen) return -1;
+  uint16_t stored = packStoredSize(e);
+  bool sealed = packSealed(header);
+  TemplateKey key;
+  if (sealed && !templateKeyForOwner(header.owner, &key)) return -1;
+  if (!sealed && !e.storedSize) {
+    return f.read(buf, e.size) == e.size ? e.size : -1;
+  }
+
+  uint8_t *blob = (uint8_t *)malloc(stored);
+  if (!blob || f.read(blob, stored) != stored) {
+    free(blob);
+    return -1;
+  }
+  int size = -1;
+  if (!sealed) {
+    size = templateDecode(blob, stored, buf, maxLen);
+  } else {
+    uint8_t *plain = (uint8_t *)malloc(stored);
+    int plainLen = plain ? templateOpen(key, blob, stored, plain,
+                                        (const uint8_t *)&e.slot, sizeof(e.slot)) : -1;
+    if (plainLen > 1 && plain[0] == PACK_CODEC_RLE) {
+      size = templateDecode(plain + 1, plainLen - 1, buf, maxLen);
+    } else if (plainLen > 1 && plain[0] == PACK_CODEC_RAW && (size_t)(plainLen - 1) <= maxLen) {
+      memcpy(buf, plain + 1, plainLen - 1);
+      size = plainLen - 1;
+    }
+    free(plain);
+  }
+  free(blob);
+  return size;
+}
+
+// Whether the loaded pack has to be rewritten: an old layout, plain with
+// a storage key now held, or sealed by another device whose key is held
+static bool packNeedsRewrite() {
+  if (packHeader.version == PACK_VERSION_LEGACY) return true;
+  bool sealing = templateKeyAvailable(TEMPLATE_KEY_STORAGE);
+  if (!packHeader.owner[0]) return sealing;
+  TemplateKey key;
+  return sealing && device_id != packHeader.owner && templateKeyForOwner(packHeader.owner, &key);
+}
+
+// Copies the pack held in TEMPLATE_PACK_OLD_FILE into the new, empty
+// pack, which seals each template if this device has a key. Removing the
+// old file is the commit point: a rewrite cut short is started again on
+// the next load.
+static void packRewrite() {
+  File f = SD.open(TEMPLATE_PACK_OLD_FILE, FILE_READ);
+  PackHeader header;
+  PackEntry *index = (PackEntry *)malloc(sizeof(packIndex));
+  uint8_t *data = (uint8_t *)malloc(TEMPLATE_MAX_BYTES);
+  if (!f || !index || !data || !packReadHeaderAndIndex(f, header, index)) {
+    LOG_E("PACK", "Cannot read %s; rewrite abandoned", TEMPLATE_PACK_OLD_FILE.c_str());
+    if (f) f.close();
+    free(index);
+    free(data);
+    return;
+  }
+
+  uint16_t count = 0, lost = 0;
+  bool ok = true;
+  for (int i = 0; ok && i < FINGER_SLOT_COUNT; i++) {
+    const PackEntry &e = index[i];
+    if (!e.slot) continue;
+    int size = f.seek(e.offset) ? packReadEntry(f, e, header, data, TEMPLATE_MAX_BYTES) : -1;
+    if (size != e.size || templateCrc(data, size) != e.crc) {
+      lost++;
+      continue;
+    }
+    ok = packPutAt(e.slot, e.empId, data, size, e.timestamp);
+    count++;
+  }
+  f.close();
+  free(index);
+  free(data);
+
+  if (!ok) {
+    LOG_E("PACK", "Rewrite failed; will retry from %s", TEMPLATE_PACK_OLD_FILE.c_str());
+    return;
+  }
+  SD.remove(TEMPLATE_PACK_OLD_FILE);
+  if (header.owner[0] && device_id != header.owner) templateForgetForeignKey();
+  LOG_I("PACK", "Rewrote %u templates %s", count, packSealed(packHeader) ? "sealed" : "plain");
+  if (lost) LOG_W("PACK", "%u corrupt templates not carried over", lost);
+}
+
+// Reads the header and index on first use, creating the pack if needed
+static bool packLoad() {
+  if (packLoaded) return true;
+  if (!SD.exists("/templates")) SD.mkdir("/templates");
+
+  // A compaction interrupted between removing the old pack and renaming
+  if (!SD.exists(TEMPLATE_PACK_FILE) && SD.exists(TEMPLATE_PACK_TMP_FILE)) {
+    SD.rename(TEMPLATE_PACK_TMP_FILE, TEMPLATE_PACK_FILE);
+  }
+
+  // A rewrite that didn't finish; its partial pack is discarded and the
+  // old one put back, to be rewritten again below if it still can be
+  if (SD.exists(TEMPLATE_PACK_OLD_FILE)) {
+    SD.remove(TEMPLATE_PACK_FILE);
+    SD.rename(TEMPLATE_PACK_OLD_FILE, TEMPLATE_PACK_FILE);
+  }
+
+  bool fresh = !SD.exists(TEMPLATE_PACK_FILE);
+  bool rewrite = false;
+  if (!fresh) {
+    File f = SD.open(TEMPLATE_PACK_FILE, FILE_READ);
+    bool ok = f && packReadHeaderAndIndex(f, packHeader, packIndex);
+    if (f) f.close();
+    TemplateKey key;
+    if (!ok) {
+      // Keep the unreadable pack for inspection rather than overwrite it
+      LOG_E("PACK", "%s unreadable; set aside as %s", TEMPLATE_PACK_FILE.c_str(), TEMPLATE_PACK_BAD_FILE.c_str());
+      SD.remove(TEMPLATE_PACK_BAD_FILE);
+      SD.rename(TEMPLATE_PACK_FILE, TEMPLATE_PACK_BAD_FILE);
+      fresh = true;
+    } else if (packNeedsRewrite()) {
+      SD.rename(TEMPLATE_PACK_FILE, TEMPLATE_PACK_OLD_FILE);
+      rewrite = true;
+      fresh = true;
+    } else if (packSealed(packHeader) && !templateKeyForOwner(packHeader.owner, &key)) {
+      LOG_W("PACK", "Pack sealed by %s; templates unreadable until its key is fetched", packHeader.owner);
+      schedulerTrigger(fetchTemplateKeysJob);
+    }
+  }
+
+  if (fresh && !packCreate()) {
+    LOG_E("PACK", "Cannot create %s", TEMPLATE_PACK_FILE.c_str());
+    return false;
+  }
+  packLoaded = true;
+  if (rewrite) packRewrite();
+  else if (fresh) packMigrateLegacyFiles();
+  return true;
+}
+
+// The device whose storage key the loaded pack needs and this device
+// lacks, for fetchTemplateKeysJob() to ask for; nullptr if none
+const char *packForeignOwner() {
+  TemplateKey key;
+  if (!packLoaded || !packSealed(packHeader) || device_id == packHeader.owner ||
+      templateKeyForOwner(packHeader.owner, &key)) {
+    return nullptr;
+  }
+  return packHeader.owner;
+}
+
+// Index entry for a slot, or nullptr if the pack has no template for it
+const PackEntry *packFind(uint16_t slot) {
+  if (slot == 0 || slot > FINGER_SLOT_COUNT || !packLoad()) return nullptr;
+  const PackEntry &e = packIndex[slot - 1];
+  return e.slot ? &e : nullptr;
+}
+
+// Next slot after `after` whose packed template has this exact content, or 0
+uint16_t packFindByContent(uint32_t crc, uint16_t size, uint16_t after = 0) {
+  if (!packLoad()) return 0;
+  for (int i = after; i < FINGER_SLOT_COUNT; i++) {
+    const PackEntry &e = packIndex[i];
+    if (e.slot && e.crc == crc && e.size == size) return e.slot;
+  }
+  return 0;
+}
+
+// Rewrites the pack with only live data, in slot order
+bool packCompact() {
+  if (!packLoad()) return false;
+  uint32_t before = packHeader.dataEnd;
+
+  SD.remove(TEMPLATE_PACK_TMP_FILE);
+  File src = SD.open(TEMPLATE_PACK_FILE, FILE_READ);
+  File dst = SD.open(TEMPLATE_PACK_TMP_FILE, FILE_WRITE);
+  bool ok = src && dst && packWriteHeaderAndIndex(dst);
+
+  // Offsets are rewritten in place; on failure the index is reloaded
+  uint32_t pos = PACK_DATA_OFFSET;
+  uint8_t buf[256];
+  for (int i = 0; ok && i < FINGER_SLOT_COUNT; i++) {
+    PackEntry &e = packIndex[i];
+    if (!e.slot) continue;
+    uint16_t stored = packStoredSize(e);
+    ok = src.seek(e.offset);
+    for (uint16_t done = 0; ok && done < stored;) {
+      size_t n = min((size_t)(stored - done), sizeof(buf));
+      ok = src.read(buf, n) == n && dst.write(buf, n) == n;
+      done += n;
+    }
+    e.offset = pos;
+    pos += stored;
+  }
+  packHeader.dataEnd = pos;
+  packHeader.liveBytes = pos - PACK_DATA_OFFSET;
+  ok = ok && packWriteHeaderAndIndex(dst);
+  if (src) src.close();
+  if (dst) dst.close();
+
+  ok = ok && SD.remove(TEMPLATE_PACK_FILE) && SD.rename(TEMPLATE_PACK_TMP_FILE, TEMPLATE_PACK_FILE);
+  if (!ok) {
+    LOG_E("PACK", "Compaction failed");
+    if (SD.exists(TEMPLATE_PACK_FILE)) SD.remove(TEMPLATE_PACK_TMP_FILE);
+    packLoaded = false;
+    return false;
+  }
+  LOG_I("PACK", "Compacted: %lu -> %lu bytes", (unsigned long)before, (unsigned long)pos);
+  return true;
+}
+
+static void packMaybeCompact() {
+  uint32_t dead = packHeader.dataEnd - PACK_DATA_OFFSET - packHeader.liveBytes;
+  if (dead >= PACK_COMPACT_MIN_BYTES && dead > packHeader.liveBytes) packCompact();
+}
+
+static bool packPutAt(uint16_t slot, uint16_t empId, const uint8_t *data, uint16_t size, uint32_t timestamp) {
+  if (slot == 0 || slot > FINGER_SLOT_COUNT || size == 0 || size > TEMPLATE_MAX_BYTES || !packLoad()) return false;
+
+  // Codec byte and body, encoded if that is smaller. A sealed pack seals
+  // both; a plain one stores the body alone, storedSize marking it encoded.
+  // A pack sealed by another device is only ever rewritten, not added to.
+  bool sealing = packSealed(packHeader);
+  if (sealing && device_id != packHeader.owner) {
+    LOG_E("PACK", "Pack sealed by %s; slot %u not written", packHeader.owner, slot);
+    return false;
+  }
+  size_t bound = 1 + templateEncodedBound(size) + TEMPLATE_SEAL_OVERHEAD;
+  uint8_t *plain = (uint8_t *)malloc(bound);
+  uint8_t *sealed = sealing ? (uint8_t *)malloc(bound) : nullptr;
+  const uint8_t *out = nullptr;
+  size_t stored = 0;
+  uint16_t storedSize = 0;
+  if (plain && (sealed || !sealing)) {
+    size_t bodySize = templateEncode(data, size, plain + 1);
+    plain[0] = PACK_CODEC_RLE;
+    if (bodySize >= size) {
+      memcpy(plain + 1, data, size);
+      bodySize = size;
+      plain[0] = PACK_CODEC_RAW;
+    }
+    if (sealing) {
+      stored = templateSeal(TEMPLATE_KEY_STORAGE, plain, 1 + bodySize, sealed,
+                            (const uint8_t *)&slot, sizeof(slot));
+      storedSize = stored;
+      out = sealed;
+    } else {
+      stored = bodySize;
+      storedSize = plain[0] == PACK_CODEC_RLE ? bodySize : 0;
+      out = plain + 1;
+    }
+  }
+
+  File f = stored ? SD.open(TEMPLATE_PACK_FILE, "r+") : File();
+  if (!f) {
+    LOG_E("PACK", "Cannot %s slot %u", stored ? "open pack for" : "seal", slot);
+    free(plain);
+    free(sealed);
+    return false;
+  }
+
+  PackEntry entry = { slot, empId, size, storedSize, templateCrc(data, size),
+                      timestamp, packHeader.dataEnd };
+  bool ok = f.seek(entry.offset) && f.write(out, stored) == stored;
+  free(plain);
+  free(sealed);
+  if (ok) {
+    f.flush();
+    PackEntry &old = packIndex[slot - 1];
+    packHeader.liveBytes += stored - (old.slot ? packStoredSize(old) : 0);
+    packHeader.dataEnd += stored;
+    old = entry;
+    ok = packWriteEntry(f, slot);
+  }
+  f.close();
+
+  if (!ok) {
+    LOG_E("PACK", "Write failed for slot %u", slot);
+    packLoaded = false;
+    return false;
+  }
+  packMaybeCompact();
+  return true;
+}
+
+bool packPut(uint16_t slot, uint16_t empId, const uint8_t *data, uint16_t size) {
+  return packPutAt(slot, empId, data, size, timeNowUnix());
+}
+
+bool packRemove(uint16_t slot) {
+  if (!packFind(slot)) return true;
+
+  File f = SD.open(TEMPLATE_PACK_FILE, "r+");
+  if (!f) return false;
+  packHeader.liveBytes -= packStoredSize(packIndex[slot - 1]);
+  memset(&packIndex[slot - 1], 0, sizeof(PackEntry));
+  bool ok = packWriteEntry(f, slot);
+  f.close();
+
+  if (!ok) {
+    packLoaded = false;
+    return false;
+  }
+  packMaybeCompact();
+  return true;
+}
+
+// Opens the pack positioned at a slot's sealed data; a closed File if
+// there is none
+static File packOpen(uint16_t slot) {
+  const PackEntry *e = packFind(slot);
+  if (!e) return File();
+  File f = SD.open(TEMPLATE_PACK_FILE, FILE_READ);
+  if (f && !f.seek(e->offset)) f.close();
+  return f;
+}
+
+// Copies a slot's template into buf; its size, or -1 if missing or corrupt
+int packRead(uint16_t slot, uint8_t *buf, size_t maxLen) {
+  const PackEntry *e = packFind(slot);
+  if (!e || e->size > maxLen) return -1;
+
+  File f = packOpen(slot);
+  if (!f) return -1;
+  int size = packReadEntry(f, *e, packHeader, buf, maxLen);
+  f.close();
+
+  if (size != e->size || templateCrc(buf, e->size) != e->crc) {
+    LOG_E("PACK", "Slot %u template corrupt", slot);
+    return -1;
+  }
+  return e->size;
+}
+
+// A new storage key, or another device's, is put to use on the next load
+void packStorageKeyChanged() {
+  packLoaded = false;
+}
+
+// Pending sync records name a packed template as "<pack file>#<slot>"
+String packRef(uint16_t slot) {
+  return TEMPLATE_PACK_FILE + "#" + String(slot);
+}
+
+// Slot named by a packRef(), or by a pre-pack "/templates/fp_NNN.bin"
+// path still queued for sync; 0 if neither
+uint16_t packRefSlot(const String &ref) {
+  if (ref.startsWith(TEMPLATE_PACK_FILE + "#")) {
+    return ref.substring(TEMPLATE_PACK_FILE.length() + 1).toInt();
+  }
+  if (ref.startsWith("/templates/fp_") && ref.endsWith(".bin")) {
+    return ref.substring(14, ref.length() - 4).toInt();
+  }
+  return 0;
+}
+
+void printPackIndex() {
+  Serial.println("\n=== Template Pack ===");
+  if (!packLoad()) {
+    Serial.println("Pack unavailable");
+    return;
+  }
+  Serial.println("slot  emp   size  stored  crc       exported");
+  int count = 0;
+  uint32_t rawBytes = 0;
+  for (int i = 0; i < FINGER_SLOT_COUNT; i++) {
+    const PackEntry &e = packIndex[i];
+    if (!e.slot) continue;
+    char when[TS_LOG_LEN];
+    formatLogTimestamp(when, e.timestamp);
+    Serial.printf("%4u %4u %6u %7u  %08lX  %s\n", e.slot, e.empId, e.size, packStoredSize(e),
+                  (unsigned long)e.crc, when);
+    rawBytes += e.size;
+    count++;
+  }
+  uint32_t dead = packHeader.dataEnd - PACK_DATA_OFFSET - packHeader.liveBytes;
+  Serial.printf("Total: %d templates, %lu bytes live, %lu bytes dead\n",
+                count, (unsigned long)packHeader.liveBytes, (unsigned long)dead);
+  if (packHeader.liveBytes) {
+    Serial.printf("Compression: %lu -> %lu bytes%s (%.2f:1)\n", (unsigned long)rawBytes,
+                  (unsigned long)packHeader.liveBytes, packSealed(packHeader) ? " sealed" : "",
+                  (float)rawBytes / packHeader.liveBytes);
+  }
+  printTemplateCryptoStats();
+  Serial.println("=====================\n");
+}
+
+#endif
\ No newline at end of file
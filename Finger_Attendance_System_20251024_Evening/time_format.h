@@ -0,0 +1,131 @@
+#ifndef TIME_FORMAT_H
+#define TIME_FORMAT_H
+
+#include <RTClib.h>
+
+// Timestamp formatting into caller-provided buffers, with no heap use.
+// Two-digit fields are copied from a lookup table, and the calendar date
+// is only worked out again when the day changes; within a day the time
+// part comes straight from seconds-of-day arithmetic.
+//
+// Times are the device's local time as kept by the RTC. The ISO form
+// carries a "Z" suffix because that is what the server has always been
+// sent.
+
+const size_t TS_ISO_LEN = 21;    // YYYY-MM-DDTHH:MM:SSZ
+const size_t TS_LOG_LEN = 20;    // YYYY-MM-DD HH:MM:SS
+const size_t TS_CLOCK_LEN = 9;   // HH:MM:SS
+const size_t TS_DATE_LEN = 11;   // DD/MM/YYYY
+
+constexpr char TWO_DIGITS[] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+struct CalendarDay {
+  uint32_t dayNumber;  // unixTime / 86400
+  uint16_t year;
+  uint8_t month;
+  uint8_t day;
+  char iso[11];        // YYYY-MM-DD
+  char display[11];    // DD/MM/YYYY
+};
+
+static portMUX_TYPE calendarMux = portMUX_INITIALIZER_UNLOCKED;
+static CalendarDay calendarCache = { UINT32_MAX };
+
+static inline char *putTwoDigits(char *out, uint8_t value) {
+  out[0] = TWO_DIGITS[value * 2];
+  out[1] = TWO_DIGITS[value * 2 + 1];
+  return out + 2;
+}
+
+static inline char *putFourDigits(char *out, uint16_t value) {
+  out = putTwoDigits(out, value / 100);
+  return putTwoDigits(out, value % 100);
+}
+
+// Calendar fields for the day containing unixTime; recomputed once per day
+CalendarDay calendarDay(uint32_t unixTime) {
+  uint32_t dayNumber = unixTime / 86400;
+
+  portENTER_CRITICAL(&calendarMux);
+  CalendarDay cal = calendarCache;
+  portEXIT_CRITICAL(&calendarMux);
+  if (cal.dayNumber == dayNumber) return cal;
+
+  DateTime midnight(dayNumber * 86400);
+  cal.dayNumber = dayNumber;
+  cal.year = midnight.year();
+  cal.month = midnight.month();
+  cal.day = midnight.day();
+
+  char *p = putFourDigits(cal.iso, cal.year);
+  *p++ = '-';
+  p = putTwoDigits(p, cal.month);
+  *p++ = '-';
+  p = putTwoDigits(p, cal.day);
+  *p = '\0';
+
+  p = putTwoDigits(cal.display, cal.day);
+  *p++ = '/';
+  p = putTwoDigits(p, cal.month);
+  *p++ = '/';
+  p = putFourDigits(p, cal.year);
+  *p = '\0';
+
+  portENTER_CRITICAL(&calendarMux);
+  calendarCache = cal;
+  portEXIT_CRITICAL(&calendarMux);
+  return cal;
+}
+
+static char *putClock(char *out, uint32_t unixTime) {
+  uint32_t secOfDay = unixTime % 86400;
+  out = putTwoDigits(out, secOfDay / 3600);
+  *out++ = ':';
+  out = putTwoDigits(out, (secOfDay / 60) % 60);
+  *out++ = ':';
+  return putTwoDigits(out, secOfDay % 60);
+}
+
+static size_t formatDateTime(char *buf, uint32_t unixTime, char separator, bool utcSuffix) {
+  CalendarDay cal = calendarDay(unixTime);
+  memcpy(buf, cal.iso, 10);
+  char *p = buf + 10;
+  *p++ = separator;
+  p = putClock(p, unixTime);
+  if (utcSuffix) *p++ = 'Z';
+  *p = '\0';
+  return p - buf;
+}
+
+// buf must hold TS_ISO_LEN bytes
+size_t formatIsoTimestamp(char *buf, uint32_t unixTime) {
+  return formatDateTime(buf, unixTime, 'T', true);
+}
+
+// buf must hold TS_LOG_LEN bytes
+size_t formatLogTimestamp(char *buf, uint32_t unixTime) {
+  return formatDateTime(buf, unixTime, ' ', false);
+}
+
+// buf must hold TS_CLOCK_LEN bytes
+void formatClock(char *buf, uint32_t unixTime) {
+  *putClock(buf, unixTime) = '\0';
+}
+
+// buf must hold TS_DATE_LEN bytes
+void formatDisplayDate(char *buf, uint32_t unixTime) {
+  CalendarDay cal = calendarDay(unixTime);
+  memcpy(buf, cal.display, TS_DATE_LEN);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,207 @@
+#ifndef TIME_SERVICE_H
+#define TIME_SERVICE_H
+
+#include "config.h"
+#include "globals.h"
+#include "scheduler.h"
+#include "time_format.h"
+#include "esp_timer.h"
+
+// Software wall clock. The DS3231 is read over I2C once at boot (and on
+// the hourly resync); after that the clock advances on the RTC's 1 Hz
+// square wave, which is aligned with its seconds rollover. If no SQW
+// edge arrives (pin not wired), time keeps running from esp_timer.
+//
+// Consumers get the time, a broken-down snapshot and preformatted
+// strings without touching I2C. NTP corrections go through timeSet(),
+// which writes the RTC and rebases the clock.
+//
+// Every timestamp can be tagged with a TimeQuality: whether the clock has
+// been confirmed by NTP recently, is running on the RTC alone, or came up
+// from an RTC that lost power and has not been corrected since.
+
+enum TimeQuality : uint8_t {
+  TIME_UNSYNCED,  // RTC lost power and no NTP sync yet
+  TIME_RTC,       // RTC only; last NTP sync too old or never
+  TIME_NTP        // NTP sync within TIME_QUALITY_MAX_AGE_S
+};
+
+struct TimeSnapshot {
+  uint32_t unixTime;
+  uint16_t year;
+  uint8_t month;
+  uint8_t day;
+  uint8_t hour;
+  uint8_t minute;
+  uint8_t second;
+  char clock[9];   // HH:MM:SS
+  char date[11];   // DD/MM/YYYY
+};
+
+static portMUX_TYPE timeMux = portMUX_INITIALIZER_UNLOCKED;
+static volatile uint32_t timeTickUnix = 0;  // Unix seconds at the last SQW edge or rebase
+static volatile int64_t timeTickUs = 0;     // esp_timer time of that edge
+static volatile int64_t timeLastEdgeUs = 0;
+static volatile uint32_t timeEdges = 0;
+static TimeSnapshot timeCache = {};
+static bool timeRtcLostPower = false;
+static volatile uint32_t timeLastNtpUnix = 0;
+
+void IRAM_ATTR onRtcSquareWave() {
+  int64_t nowUs = esp_timer_get_time();
+  portENTER_CRITICAL_ISR(&timeMux);
+  // Ignore glitches; real edges are one second apart
+  if (nowUs - timeLastEdgeUs > RTC_SQW_MIN_PERIOD_US) {
+    timeTickUnix = timeTickUnix + 1;
+    timeTickUs = nowUs;
+    timeLastEdgeUs = nowUs;
+    timeEdges = timeEdges + 1;
+  }
+  portEXIT_CRITICAL_ISR(&timeMux);
+}
+
+// Whether SQW edges are arriving, so the clock already follows the RTC
+static bool timeSqwTicking() {
+  portENTER_CRITICAL(&timeMux);
+  int64_t lastEdgeUs = timeLastEdgeUs;
+  portEXIT_CRITICAL(&timeMux);
+  return lastEdgeUs && esp_timer_get_time() - lastEdgeUs < RTC_SQW_STALE_US;
+}
+
+// Read the DS3231 and rebase the software clock on it. The RTC reports
+// whole seconds only, so a plain read can leave the clock up to a second
+// behind until the next SQW edge. With alignToRollover the rebase waits
+// for the RTC's seconds to change, keeping the sub-second phase to
+// within RTC_ROLLOVER_POLL_MS.
+void timeResync(bool alignToRollover = false) {
+  uint32_t edges;
+  uint32_t unixTime;
+  int64_t readUs;
+  do {
+    edges = timeEdges;
+    readUs = esp_timer_get_time();
+    unixTime = rtc.now().unixtime();
+  } while (edges != timeEdges);  // An edge landed mid-read; the value may be stale
+
+  if (alignToRollover) {
+    uint32_t first = unixTime;
+    int64_t deadlineUs = readUs + RTC_ROLLOVER_TIMEOUT_MS * 1000LL;
+    while (unixTime == first && readUs < deadlineUs) {
+      delay(RTC_ROLLOVER_POLL_MS);
+      readUs = esp_timer_get_time();
+      unixTime = rtc.now().unixtime();
+    }
+  } else {
+    readUs = esp_timer_get_time();
+  }
+
+  portENTER_CRITICAL(&timeMux);
+  timeTickUnix = unixTime;
+  timeTickUs = readUs;
+  portEXIT_CRITICAL(&timeMux);
+}
+
+bool timeBegin() {
+  if (!rtc.begin()) return false;
+  timeRtcLostPower = rtc.lostPower();
+  if (timeRtcLostPower) rtc.adjust(DateTime(F(__DATE__), F(__TIME__)));
+
+#if RTC_SQW_PIN >= 0
+  rtc.writeSqwPinMode(DS3231_SquareWave1Hz);
+  pinMode(RTC_SQW_PIN, INPUT_PULLUP);
+  attachInterrupt(digitalPinToInterrupt(RTC_SQW_PIN), onRtcSquareWave, FALLING);
+#endif
+
+  // With SQW wired its first edge fixes the phase; without, wait for it
+  timeResync(RTC_SQW_PIN < 0);
+  return true;
+}
+
+uint32_t timeNowUnix() {
+  portENTER_CRITICAL(&timeMux);
+  uint32_t unixTime = timeTickUnix;
+  int64_t tickUs = timeTickUs;
+  portEXIT_CRITICAL(&timeMux);
+
+  // Whole seconds since the last edge: 0 while SQW is ticking
+  return unixTime + (uint32_t)((esp_timer_get_time() - tickUs) / 1000000);
+}
+
+// Microseconds since the (local) epoch, for measuring NTP offsets
+int64_t timeNowUs() {
+  portENTER_CRITICAL(&timeMux);
+  uint32_t unixTime = timeTickUnix;
+  int64_t tickUs = timeTickUs;
+  portEXIT_CRITICAL(&timeMux);
+
+  return (int64_t)unixTime * 1000000 + (esp_timer_get_time() - tickUs);
+}
+
+DateTime timeNow() {
+  return DateTime(timeNowUnix());
+}
+
+TimeSnapshot timeSnapshot() {
+  uint32_t unixTime = timeNowUnix();
+
+  portENTER_CRITICAL(&timeMux);
+  bool fresh = timeCache.unixTime == unixTime;
+  TimeSnapshot snap = timeCache;
+  portEXIT_CRITICAL(&timeMux);
+  if (fresh) return snap;
+
+  CalendarDay cal = calendarDay(unixTime);
+  uint32_t secOfDay = unixTime % 86400;
+  snap.unixTime = unixTime;
+  snap.year = cal.year;
+  snap.month = cal.month;
+  snap.day = cal.day;
+  snap.hour = secOfDay / 3600;
+  snap.minute = (secOfDay / 60) % 60;
+  snap.second = secOfDay % 60;
+  formatClock(snap.clock, unixTime);
+  memcpy(snap.date, cal.display, sizeof(snap.date));
+
+  portENTER_CRITICAL(&timeMux);
+  timeCache = snap;
+  portEXIT_CRITICAL(&timeMux);
+  return snap;
+}
+
+// Apply an external correction (NTP) to both the RTC and the software clock
+void timeSet(const DateTime &dt) {
+  rtc.adjust(dt);
+  portENTER_CRITICAL(&timeMux);
+  timeTickUnix = dt.unixtime();
+  timeTickUs = esp_timer_get_time();
+  portEXIT_CRITICAL(&timeMux);
+}
+
+// Record that the clock was just confirmed against NTP
+void timeMarkSynced() {
+  timeLastNtpUnix = timeNowUnix();
+}
+
+TimeQuality timeQuality() {
+  uint32_t lastNtp = timeLastNtpUnix;
+  if (lastNtp == 0) return timeRtcLostPower ? TIME_UNSYNCED : TIME_RTC;
+  return timeNowUnix() - lastNtp <= TIME_QUALITY_MAX_AGE_S ? TIME_NTP : TIME_RTC;
+}
+
+const char *timeQualityName(TimeQuality quality) {
+  switch (quality) {
+    case TIME_NTP: return "ntp";
+    case TIME_RTC: return "rtc";
+    default: return "unsynced";
+  }
+}
+
+// Scheduled every TIME_RESYNC_INTERVAL to cancel esp_timer drift when SQW
+// is absent; skipped while edges arrive, since a rebase would only
+// disturb a clock that is already in step with the RTC
+JobResult timeResyncJob() {
+  if (!timeSqwTicking()) timeResync(true);
+  return JOB_DONE;
+}
+
+#endif
@@ -3,24 +3,19 @@
 
 #include "config.h"
 #include "globals.h"
+#include "display_task.h"
+#include "feedback_functions.h"
 
 // Basic Utility Functions
 void buzzerSuccess() {
-  digitalWrite(BUZZER_PIN, HIGH);
-  delay(200);
-  digitalWrite(BUZZER_PIN, LOW);
+  playBuzzer(BUZZ_SUCCESS);
 }
 
 void buzzerFail() {
-  for (int i = 0; i < 2; i++) {
-    digitalWrite(BUZZER_PIN, HIGH);
-    delay(100);
-    digitalWrite(BUZZER_PIN, LOW);
-    delay(100);
-  }
+  playBuzzer(BUZZ_FAIL);
 }
 
-String getNameByID(int id) {
+const char *getNameByID(int id) {
   switch (id) {
     case 1: return "Admin";
     case 2: return "Lion";
@@ -32,28 +27,18 @@ String getNameByID(int id) {
 
 void successMessage(String msg) {
   Serial.println("✅ " + msg);
-  display.clearDisplay();
-  display.setTextSize(2);
-  display.setCursor((128 - 6 * 2 * 8) / 2, 0);
-  display.println("Success!");
-  display.setCursor(0, 40);
-  display.println(msg);
-  display.display();
-  buzzerSuccess();
-  delay(2000);
+  ScreenFrame frame = textScreen();
+  addScreenLine(frame, (128 - 6 * 2 * 8) / 2, 0, 2, "Success!");
+  addScreenLine(frame, 0, 40, 2, "%s", msg.c_str());
+  showFeedback(frame, BUZZ_SUCCESS);
 }
 
 void failMessage(String msg) {
   Serial.println("❌ " + msg);
-  display.clearDisplay();
-  display.setTextSize(2);
-  display.setCursor((128 - 6 * 2 * 7) / 2, 0);
-  display.println("Failed!");
-  display.setCursor(0, 40);
-  display.println(msg);
-  display.display();
-  buzzerFail();
-  delay(2000);
+  ScreenFrame frame = textScreen();
+  addScreenLine(frame, (128 - 6 * 2 * 7) / 2, 0, 2, "Failed!");
+  addScreenLine(frame, 0, 40, 2, "%s", msg.c_str());
+  showFeedback(frame, BUZZ_FAIL);
 }
 
 #endif
\ No newline at end of file
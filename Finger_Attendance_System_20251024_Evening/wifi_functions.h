@@ -4,8 +4,15 @@
 #include "config.h"
 #include "globals.h"
 #include "sd_functions.h"
+#include "display_task.h"
+#include "scheduler.h"
+#include "punch_metrics.h"
+
+static unsigned long wifiAttemptStart = 0;
+static bool configModeActive = false;  // The config pages answer only while set
 
 // WiFi Functions
+// Starts the connection and returns; maintainWiFi() picks up the result
 void initWiFi(const WiFiConfig &config) {
   if (config.ssid.length() == 0) {
     Serial.println("No WiFi credentials configured");
@@ -13,63 +20,51 @@ void initWiFi(const WiFiConfig &config) {
   }
 
   WiFi.disconnect(true);
-  delay(100);
   WiFi.mode(WIFI_STA);
   WiFi.begin(config.ssid.c_str(), config.password.c_str());
+  wifiAttemptStart = millis();
+  Serial.println("Connecting to WiFi in background...");
 
-  Serial.print("Connecting to WiFi");
-  unsigned long startTime = millis();
-  const unsigned long timeout = 30000;
-
-  while (WiFi.status() != WL_CONNECTED && millis() - startTime < timeout) {
-    delay(500);
-    Serial.print(".");
-    if (millis() - startTime > 10000 && WiFi.status() == WL_NO_SSID_AVAIL) {
-      Serial.println("\nNetwork not found");
-      break;
-    }
-  }
-
-  if (WiFi.status() == WL_CONNECTED) {
-    wifiConnected = true;
-    Serial.println("\nConnected!");
-    Serial.print("IP address: ");
-    Serial.println(WiFi.localIP());
-
-    if (ntpServer && ntpServer != "pool.ntp.org") {
-      free((void *)ntpServer);
-    }
-    ntpServer = strdup(config.ntpServer.c_str());
-    configTime(gmtOffset_sec, daylightOffset_sec, ntpServer);
-  } else {
-    Serial.println("\nConnection failed!");
+  // SNTP starts polling as soon as the interface comes up
+  if (ntpServer && ntpServer != "pool.ntp.org") {
+    free((void *)ntpServer);
   }
+  ntpServer = strdup(config.ntpServer.c_str());
+  configTime(gmtOffset_sec, daylightOffset_sec, ntpServer);
 }
 
-void maintainWiFi() {
-  static unsigned long lastCheck = 0;
-  const unsigned long checkInterval = 30000;
-
-  if (millis() - lastCheck > checkInterval) {
-    lastCheck = millis();
-    if (WiFi.status() != WL_CONNECTED) {
-      wifiConnected = false;
-      Serial.println("WiFi disconnected. Attempting to reconnect...");
-      WiFi.disconnect();
-      delay(100);
-      WiFi.reconnect();
-      delay(100);
-    } else if (!wifiConnected) {
+// Scheduled every WIFI_CHECK_INTERVAL; polls every WIFI_POLL_INTERVAL
+// (backing off) while a connection attempt is in progress
+JobResult maintainWiFi() {
+  if (WiFi.status() == WL_CONNECTED) {
+    if (!wifiConnected) {
       wifiConnected = true;
-      Serial.println("WiFi reconnected!");
+      Serial.println("WiFi connected!");
       Serial.print("IP address: ");
       Serial.println(WiFi.localIP());
     }
+    return JOB_DONE;
+  }
+
+  wifiConnected = false;
+  if (millis() - wifiAttemptStart < WIFI_CONNECT_TIMEOUT) {
+    return JOB_RETRY;  // Still associating
   }
+
+  Serial.println("WiFi disconnected. Attempting to reconnect...");
+  WiFi.disconnect();
+  delay(100);
+  WiFi.reconnect();
+  wifiAttemptStart = millis();
+  return JOB_RETRY;
 }
 
 // Web Server Handlers
 void handleRoot() {
+  if (!configModeActive) {
+    server.send(404, "text/plain", "Not Found");
+    return;
+  }
   String html = R"=====(
     <!DOCTYPE html>
     <html>
@@ -103,6 +98,10 @@ void handleRoot() {
 }
 
 void handleSaveSD() {
+  if (!configModeActive) {
+    server.send(404, "text/plain", "Not Found");
+    return;
+  }
   if (server.hasArg("ssid")) {
     WiFiConfig config;
     config.ssid = server.arg("ssid");
@@ -132,7 +131,11 @@ void handleSaveSD() {
   }
 }
 
+// Runs the config portal on the web server, taken from the metrics task
+// for the duration and handed back (restarted) on the way out
 void enterConfigMode() {
+  metricsPause();
+  configModeActive = true;
   WiFi.disconnect(true);
   delay(1000);
 
@@ -146,16 +149,11 @@ void enterConfigMode() {
   server.onNotFound(handleRoot);
   server.begin();
 
-  display.clearDisplay();
-  display.setTextSize(1);
-  display.setCursor(0, 0);
-  display.println("CONFIG MODE");
-  display.setCursor(0, 16);
-  display.print("SSID: ");
-  display.println(apName);
-  display.setCursor(0, 32);
-  display.println("IP: 192.168.4.1");
-  display.display();
+  ScreenFrame frame = textScreen();
+  addScreenLine(frame, 0, 0, 1, "CONFIG MODE");
+  addScreenLine(frame, 0, 16, 1, "SSID: %s", apName.c_str());
+  addScreenLine(frame, 0, 32, 1, "IP: 192.168.4.1");
+  postScreen(frame);
 
   unsigned long configStartTime = millis();
   const unsigned long timeout = 60000;
@@ -170,6 +168,8 @@ void enterConfigMode() {
   server.stop();
   dnsServer.stop();
   WiFi.softAPdisconnect(true);
+  configModeActive = false;
+  metricsResume();
 }
 
 #endif
\ No newline at end of file